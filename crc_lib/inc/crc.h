@@ -3,8 +3,25 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern const uint32_t __crc32_table[256];
 
 uint32_t crc32(const void* data, size_t nbytes);
 
+/* Continues a CRC32 over the next chunk, crc32_update(0, ..) == crc32(..),
+   crc32_update(crc32(a), b) == crc32(a followed by b) */
+uint32_t crc32_update(uint32_t crc, const void* data, size_t nbytes);
+
+/* CRC32C (Castagnoli), same conventions as crc32 / crc32_update. Uses the SSE4.2
+   crc32 instruction when built with CRC32C_SSE42 and the CPU has it, else tables */
+uint32_t crc32c(const void* data, size_t nbytes);
+uint32_t crc32c_update(uint32_t crc, const void* data, size_t nbytes);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
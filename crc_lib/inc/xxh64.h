@@ -0,0 +1,34 @@
+#ifndef XXH64_H
+#define XXH64_H
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+    XXH64, 64-bit non-cryptographic hash (xxHash spec, little endian digest).
+    Streaming form: xxh64_reset, xxh64_update for each chunk, xxh64_digest;
+    chunking does not change the result.
+*/
+
+typedef struct {
+    uint64_t acc[4];
+    uint64_t total_len;
+    uint64_t seed;
+    uint8_t  buf[32];  // tail of the last update, < 32 bytes
+    uint32_t buf_len;
+} xxh64_state_t;
+
+void xxh64_reset(xxh64_state_t* state, uint64_t seed);
+void xxh64_update(xxh64_state_t* state, const void* data, size_t nbytes);
+uint64_t xxh64_digest(const xxh64_state_t* state);
+
+uint64_t xxh64(const void* data, size_t nbytes, uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -69,16 +69,159 @@ const uint32_t __crc32_table[256] =
     (0xb40bbe37), (0xc30c8ea1), (0x5a05df1b), (0x2d02ef8d)
 };
 
+#if defined(CRC32_SLICE_BY_8) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#include <string.h>
+
+/* Slice-by-8 tables, derived from __crc32_table on first use (8KB RAM, host builds) */
+static uint32_t crc32_slice_table[8][256];
+static int crc32_slice_table_ready;
+
+static void crc32_slice_table_init(void)
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = __crc32_table[i];
+        crc32_slice_table[0][i] = crc;
+        for (uint32_t slice = 1; slice < 8; ++slice) {
+            crc = __crc32_table[crc & 0xFF] ^ (crc >> 8);
+            crc32_slice_table[slice][i] = crc;
+        }
+    }
+    crc32_slice_table_ready = 1;
+}
+#endif
+
 /**
  * Get standard CRC32(which the polynomial is 0x04C11DB7) value.
  */
 uint32_t crc32(const void* data, size_t nbytes)
 {
-    uint32_t crc = 0xFFFFFFFF;
-    for (size_t i = 0; i < nbytes; ++i) {
-        uint8_t k = ((uint8_t*)data)[i];
+    return crc32_update(0, data, nbytes);
+}
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t nbytes)
+{
+    crc ^= 0xFFFFFFFF;
+    const uint8_t* bytes = (const uint8_t*)data;
+    size_t i = 0;
+
+#if defined(CRC32_SLICE_BY_8) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    if (!crc32_slice_table_ready) {
+        crc32_slice_table_init();
+    }
+    for (; (i + 8) <= nbytes; i += 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, bytes + i, sizeof(lo));
+        memcpy(&hi, bytes + i + 4, sizeof(hi));
+        lo ^= crc;
+        crc = crc32_slice_table[7][lo & 0xFF] ^ crc32_slice_table[6][(lo >> 8) & 0xFF] ^
+              crc32_slice_table[5][(lo >> 16) & 0xFF] ^ crc32_slice_table[4][lo >> 24] ^
+              crc32_slice_table[3][hi & 0xFF] ^ crc32_slice_table[2][(hi >> 8) & 0xFF] ^
+              crc32_slice_table[1][(hi >> 16) & 0xFF] ^ crc32_slice_table[0][hi >> 24];
+    }
+#endif
+
+    for (; i < nbytes; ++i) {
+        uint8_t k = bytes[i];
         crc = __crc32_table[((uint8_t)(crc) ^ k) & 0xFF] ^ (crc >> 8);
     }
     return (crc ^ 0xFFFFFFFF);
+}
+
+/* CRC32C (Castagnoli, reflected polynomial 0x82F63B78) */
+#define CRC32C_POLY 0x82F63B78UL
+
+/* Table derived on first use, 1KB (8KB with CRC32_SLICE_BY_8) */
+#if defined(CRC32_SLICE_BY_8) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define CRC32C_NUM_SLICES 8
+#else
+#define CRC32C_NUM_SLICES 1
+#endif
+static uint32_t crc32c_table[CRC32C_NUM_SLICES][256];
+static int crc32c_table_ready;
+
+static void crc32c_table_init(void)
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (uint32_t bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0U - (crc & 1)));
+        }
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = crc32c_table[0][i];
+        for (uint32_t slice = 1; slice < CRC32C_NUM_SLICES; ++slice) {
+            crc = crc32c_table[0][crc & 0xFF] ^ (crc >> 8);
+            crc32c_table[slice][i] = crc;
+        }
+    }
+    crc32c_table_ready = 1;
+}
+
+#if defined(CRC32C_SSE42) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_HAVE_SSE42
+#include <string.h>
+#include <nmmintrin.h>
 
-};
\ No newline at end of file
+/* crc32 instruction, only called when cpuid reports SSE4.2 */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_update_sse42(uint32_t crc, const uint8_t* bytes, size_t nbytes)
+{
+    uint64_t crc64 = crc;
+    size_t i = 0;
+    for (; (i + 8) <= nbytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+    for (; i < nbytes; ++i) {
+        crc = _mm_crc32_u8(crc, bytes[i]);
+    }
+    return crc;
+}
+#endif
+
+uint32_t crc32c(const void* data, size_t nbytes)
+{
+    return crc32c_update(0, data, nbytes);
+}
+
+uint32_t crc32c_update(uint32_t crc, const void* data, size_t nbytes)
+{
+    crc ^= 0xFFFFFFFF;
+    const uint8_t* bytes = (const uint8_t*)data;
+    size_t i = 0;
+
+#ifdef CRC32C_HAVE_SSE42
+    static int has_sse42 = -1;
+    if (has_sse42 < 0) {
+        has_sse42 = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    }
+    if (has_sse42) {
+        return (crc32c_update_sse42(crc, bytes, nbytes) ^ 0xFFFFFFFF);
+    }
+#endif
+
+    if (!crc32c_table_ready) {
+        crc32c_table_init();
+    }
+
+#if CRC32C_NUM_SLICES == 8
+    for (; (i + 8) <= nbytes; i += 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, bytes + i, sizeof(lo));
+        memcpy(&hi, bytes + i + 4, sizeof(hi));
+        lo ^= crc;
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+    }
+#endif
+
+    for (; i < nbytes; ++i) {
+        crc = crc32c_table[0][(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return (crc ^ 0xFFFFFFFF);
+}
@@ -0,0 +1,143 @@
+#include <string.h>
+#include "xxh64.h"
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxh_rotl64(uint64_t x, unsigned r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_read64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t xxh_read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = xxh_rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh_merge_round(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/* Consumes whole 32 byte stripes, returns the number of bytes used */
+static size_t xxh_stripes(uint64_t acc[4], const uint8_t* p, size_t nbytes)
+{
+    uint64_t v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+    size_t i = 0;
+    for (; (i + 32) <= nbytes; i += 32) {
+        v1 = xxh_round(v1, xxh_read64(p + i));
+        v2 = xxh_round(v2, xxh_read64(p + i + 8));
+        v3 = xxh_round(v3, xxh_read64(p + i + 16));
+        v4 = xxh_round(v4, xxh_read64(p + i + 24));
+    }
+    acc[0] = v1; acc[1] = v2; acc[2] = v3; acc[3] = v4;
+    return i;
+}
+
+void xxh64_reset(xxh64_state_t* state, uint64_t seed)
+{
+    memset(state, 0, sizeof(*state));
+    state->seed = seed;
+    state->acc[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    state->acc[1] = seed + XXH_PRIME64_2;
+    state->acc[2] = seed;
+    state->acc[3] = seed - XXH_PRIME64_1;
+}
+
+void xxh64_update(xxh64_state_t* state, const void* data, size_t nbytes)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    state->total_len += nbytes;
+
+    if (state->buf_len > 0) {
+        size_t fill = 32 - state->buf_len;
+        if (nbytes < fill) {
+            memcpy(state->buf + state->buf_len, p, nbytes);
+            state->buf_len += (uint32_t)nbytes;
+            return;
+        }
+        memcpy(state->buf + state->buf_len, p, fill);
+        xxh_stripes(state->acc, state->buf, 32);
+        p += fill;
+        nbytes -= fill;
+        state->buf_len = 0;
+    }
+
+    size_t used = xxh_stripes(state->acc, p, nbytes);
+    memcpy(state->buf, p + used, nbytes - used);
+    state->buf_len = (uint32_t)(nbytes - used);
+}
+
+uint64_t xxh64_digest(const xxh64_state_t* state)
+{
+    uint64_t h;
+    if (state->total_len >= 32) {
+        const uint64_t* acc = state->acc;
+        h = xxh_rotl64(acc[0], 1) + xxh_rotl64(acc[1], 7) + xxh_rotl64(acc[2], 12) + xxh_rotl64(acc[3], 18);
+        h = xxh_merge_round(h, acc[0]);
+        h = xxh_merge_round(h, acc[1]);
+        h = xxh_merge_round(h, acc[2]);
+        h = xxh_merge_round(h, acc[3]);
+    } else {
+        h = state->seed + XXH_PRIME64_5;
+    }
+    h += state->total_len;
+
+    const uint8_t* p = state->buf;
+    size_t len = state->buf_len;
+    for (; len >= 8; p += 8, len -= 8) {
+        h ^= xxh_round(0, xxh_read64(p));
+        h = xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (len >= 4) {
+        h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+        h = xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+        len -= 4;
+    }
+    for (; len > 0; ++p, --len) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h = xxh_rotl64(h, 11) * XXH_PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t xxh64(const void* data, size_t nbytes, uint64_t seed)
+{
+    xxh64_state_t state;
+    xxh64_reset(&state, seed);
+    xxh64_update(&state, data, nbytes);
+    return xxh64_digest(&state);
+}
@@ -6,19 +6,32 @@
 #include <stdbool.h>
 
 /* 
-    Copies a number of bytes from file to program array.
+    Copies a number of bytes from a given offset in the state file to program array.
+    INPUT: Byte offset within the file
     INPUT: Pointer to array to be written
     INPUT: Length of data to be written to array
-    RETURNS: True on success, else False
+    RETURNS: True on success, else False (including reads past end of file)
 */
-bool load_state(uint8_t* state, uint32_t len);
+bool load_state_at(uint64_t offset, uint8_t* state, uint32_t num_bytes);
 
 /* 
-    Writes a number of bytes from program to file.
+    Writes a number of bytes from program to a given offset in the state file,
+    the file is created if missing. Skipped ranges are left as holes.
+    INPUT: Byte offset within the file
     INPUT: Pointer to array to be saved
     INPUT: Length of data to be saved
     RETURNS: True on success, else False
 */
-bool save_state(uint8_t *state, uint32_t num_bytes);
+bool save_state_at(uint64_t offset, const uint8_t* state, uint32_t num_bytes);
+
+/* 
+    Copies up to max_bytes from the named file to program array.
+    INPUT: Path of file to be read
+    INPUT: Pointer to array to be written
+    INPUT: Capacity of the array in bytes
+    OUTPUT: Number of bytes actually read
+    RETURNS: True on success (at least one byte read), else False
+*/
+bool load_file(const char* path, uint8_t* data, uint32_t max_bytes, uint32_t* num_bytes_read);
 
 #endif
\ No newline at end of file
@@ -1,62 +1,68 @@
 #include "file_io.h"
 
+#define STATE_FILE "nv_state"
+
 /* 
     This module ONLY exists to provide faux 
     flash persistence via file save / load.
 */
 
-bool load_state(uint8_t *state, uint32_t num_bytes)
+bool load_state_at(uint64_t offset, uint8_t *state, uint32_t num_bytes)
 {
     if (state == NULL || num_bytes == 0)
     {
-        printf("file_io:load_state: bad arguments, failed\n");
+        printf("file_io:load_state_at: bad arguments, failed\n");
         return false;
     }
 
-    FILE *f = fopen("nv_state", "rb");
+    FILE *f = fopen(STATE_FILE, "rb");
 
     if (f == NULL)
     {
-        printf("file_io:load_state: fopen failed\n");
-        return false;
+        return false; // Missing file is expected on first run, caller reports
     }
 
-    if (fread(state, 1, num_bytes, f) != (size_t)num_bytes)
+    if ((fseeko(f, (off_t)offset, SEEK_SET) != 0) ||
+        (fread(state, 1, num_bytes, f) != (size_t)num_bytes))
     {
-        printf("file_io:load_state: fread failed\n");
         fclose(f);
         return false;
     }
 
     if (fclose(f) != 0)
     {
-        printf("file_io:load_state: fclose failed\n");
+        printf("file_io:load_state_at: fclose failed\n");
         return false;
     }
 
-    return true;  // TODO: switch to a status enum
+    return true;
 }
 
-bool save_state(uint8_t *state, uint32_t num_bytes)
+bool save_state_at(uint64_t offset, const uint8_t *state, uint32_t num_bytes)
 {
     if (state == NULL || num_bytes == 0)
     {
-        printf("file_io:save_state: bad arguments, failed\n");
+        printf("file_io:save_state_at: bad arguments, failed\n");
         return false;
     }
 
-    FILE *f = fopen("nv_state", "wb");
+    // Update in place, create on first save
+    FILE *f = fopen(STATE_FILE, "r+b");
+    if (f == NULL)
+    {
+        f = fopen(STATE_FILE, "w+b");
+    }
 
     if (f == NULL)
     {
-        printf("file_io:save_state: fopen failed\n");
+        printf("file_io:save_state_at: fopen failed\n");
         return false;
     }
 
-    // Write state to file
-    if (fwrite(state, 1, num_bytes, f) != (size_t)num_bytes)
+    if ((fseeko(f, (off_t)offset, SEEK_SET) != 0) ||
+        (fwrite(state, 1, num_bytes, f) != (size_t)num_bytes))
     {
-        printf("file_io:save_state: fwrite failed\n");
+        printf("file_io:save_state_at: fwrite failed\n");
         fclose(f);
         return false;
     }
@@ -64,16 +70,43 @@ bool save_state(uint8_t *state, uint32_t num_bytes)
     // force flush
     if (fflush(f) != 0)
     {
-        printf("file_io:save_state: fflush failed\n");
+        printf("file_io:save_state_at: fflush failed\n");
         fclose(f);
         return false;
     }
 
     if (fclose(f) != 0)
     {
-        printf("file_io:save_state: fclose failed\n");
+        printf("file_io:save_state_at: fclose failed\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool load_file(const char* path, uint8_t* data, uint32_t max_bytes, uint32_t* num_bytes_read)
+{
+    if (path == NULL || data == NULL || max_bytes == 0 || num_bytes_read == NULL)
+    {
+        printf("file_io:load_file: bad arguments, failed\n");
+        return false;
+    }
+
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL)
+    {
+        printf("file_io:load_file: fopen failed\n");
+        return false;
+    }
+
+    *num_bytes_read = (uint32_t)fread(data, 1, max_bytes, f);
+
+    if (fclose(f) != 0)
+    {
+        printf("file_io:load_file: fclose failed\n");
         return false;
     }
 
-    return true;  // TODO: switch to a status enum
+    return (*num_bytes_read > 0);
 }
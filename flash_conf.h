@@ -5,9 +5,11 @@
 
 //default config
 
-#define CFG_NUM_PAGES 4
+#define CFG_NUM_PAGES 6
+#define CFG_NUM_SECTORS 3
 #define CFG_NUM_FLASH_KEYS 2
 #define CFG_APP_DATA_NUM_COPIES 3
+#define CFG_APP_DATA_MAX_COPIES 8
 
 #define CFG_HAS_PAGES
 #define CFG_HAS_KEYS
@@ -29,6 +31,22 @@
 #define CFG_PAGE4_BASE_ADDR 0x08080000
 #define CFG_PAGE4_NUM_BYTES NUM_KB_TO_NUM_BYTE(128)
 
+#define CFG_PAGE5_BASE_ADDR 0x080A0000
+#define CFG_PAGE5_NUM_BYTES NUM_KB_TO_NUM_BYTE(128)
+
+#define CFG_PAGE6_BASE_ADDR 0x080C0000
+#define CFG_PAGE6_NUM_BYTES NUM_KB_TO_NUM_BYTE(128)
+
+// Sectors, as page ranges erasable in one operation
+#define CFG_SECTOR1_FIRST_PAGE 0
+#define CFG_SECTOR1_NUM_PAGES  2
+
+#define CFG_SECTOR2_FIRST_PAGE 2
+#define CFG_SECTOR2_NUM_PAGES  2
+
+#define CFG_SECTOR3_FIRST_PAGE 4
+#define CFG_SECTOR3_NUM_PAGES  2
+
 #define CFG_FLASH_KEY1 0x45670123
 #define CFG_FLASH_KEY2 0xCDEF89AB
 
@@ -5,12 +5,44 @@
 #include <stdint.h>
 #include <assert.h>
 #include "ll_flash.h"
+#include "flash_integrity.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Distinct page_dsc_t.bank ids flash_init spreads the copies over (flash_config_t.num_banks)
+#define FLASH_MAX_BANKS 4
+
+// Rollbacks a single copy can take before it must be re-committed
+#define FLASH_META_NUM_ACTIVATIONS 4
+
+// Fields programmed in place after the commit write (validity, activation slots) each
+// own a whole unit, so parts with up to 128 bit one-program-per-word ECC can take them
+#define FLASH_META_PROGRAM_UNIT 16
+
+// A rollback re-activation, programmed in one go. Only counts when inverse == ~sequence,
+// so a slot torn by power loss reads as never programmed.
+typedef struct
+{
+    uint32_t sequence;
+    uint32_t inverse;
+    uint8_t  _unit_pad[FLASH_META_PROGRAM_UNIT - 8];
+} app_data_activation_t;
+
+// Laid out in program order: validity and activation slots are left erased by the
+// commit, which programs length onwards (and the app_data after it) in one go
 typedef struct
 {
     uint32_t validity;
+    uint8_t  _unit_pad[FLASH_META_PROGRAM_UNIT - 4];
+    app_data_activation_t activations[FLASH_META_NUM_ACTIVATIONS];
     uint32_t length;
-    uint32_t crc32;
+    uint32_t sequence;
+    uint32_t integrity_id;  // flash_integrity_t id of the algorithm which computed check
+    uint32_t _reserved;
+    uint64_t check;         // integrity value of the app_data
+    uint64_t _reserved2;
 } app_data_meta_t;
 
 typedef enum
@@ -25,6 +57,9 @@ typedef enum
     flash_status_ll_write_fault,
     flash_status_ll_read_fault,
     flash_status_ll_erase_fault,
+    flash_status_version_not_found,
+    flash_status_rollback_slots_exhausted,
+    flash_status_invalid_config,
 } flash_status_t;
 
 typedef union
@@ -35,32 +70,109 @@ typedef union
 } app_data_t;
 
 
+// One contiguous piece of app_data, a copy stores all segments back to back
+typedef struct
+{
+    uint8_t* data;
+    uint32_t num_bytes;
+} flash_data_seg_t;
+
+// Either a single app_data buffer, or (num_segments > 0) a list of segments
+// which are committed as one copy with one integrity check. With segments, data_num_bytes
+// is computed by flash_init.
 typedef struct __attribute__((packed)) 
 {
 	uint32_t data_num_bytes;
     app_data_meta_t _app_data_meta;
     uint8_t* app_data;
+    const flash_data_seg_t* segments;
+    uint32_t num_segments;
 } flash_data_dsc_t;
 
+// Pages one app_data copy occupies
+typedef struct
+{
+    uint32_t base_page_idx;
+    uint32_t num_pages;
+} flash_copy_span_t;
+
 typedef struct
 {
     bool has_valid_data;
     bool initialized;
-    uint8_t num_app_data_copies;
-	uint8_t pages_per_app_data_copy;
+    uint32_t num_app_data_copies;     // 2..CFG_APP_DATA_MAX_COPIES, the active copy is never erased
+	uint32_t pages_per_app_data_copy;
     uint32_t total_num_bytes_of_flash;
 	flash_data_dsc_t data_descriptor;
     ll_flash_config_t ll;
 
+    // Optional copy placement worked out ahead of time (num_app_data_copies spans, e.g.
+    // by flash.hpp at compile time), NULL has flash_init compute it from the page table.
+    // flash_init still checks each span (within the pages, contiguous, one bank, holds a
+    // copy, no page shared with another span), else flash_status_invalid_config.
+    const flash_copy_span_t* copy_layout;
+
+    // Read-while-write banks (distinct page_dsc_t.bank ids) the copies are dealt over, up to
+    // FLASH_MAX_BANKS. 0 or 1 keeps every copy in the bank of the first page. The banks are
+    // taken in order of first appearance, pages are only read up to the last one's first page.
+    uint32_t num_banks;
+
+    // Integrity algorithm for new commits, NULL picks flash_integrity_crc32. Copies are
+    // checked with the algorithm named in their header, looked up in integrity, then
+    // integrity_algs (deployment specific ids), then the built-ins.
+    const flash_integrity_t* integrity;
+    const flash_integrity_t* const* integrity_algs;
+    uint32_t num_integrity_algs;
+
 } flash_config_t;
 
+// One retained (committed) app_data copy
+typedef struct
+{
+    uint32_t copy_idx;
+    uint32_t version;      // sequence assigned when the copy was committed
+    uint32_t activation;   // latest of version and any rollback re-activations
+    uint32_t length;
+    uint32_t integrity_id; // algorithm which wrote the copy
+    uint32_t bank;         // bank of the pages holding the copy
+    bool crc_ok;           // integrity check passed (false for an unknown algorithm)
+    bool active;
+} flash_version_info_t;
+
+// Integrity of a retained copy as last seen by flash_init, a commit, a rollback or the scrubber
+typedef enum
+{
+    flash_health_unchecked,  // not verified since init
+    flash_health_ok,
+    flash_health_corrupt,    // integrity check failed, bad header or unknown algorithm
+} flash_health_t;
+
+typedef struct
+{
+    uint32_t passes;          // completed sweeps over the inactive copies
+    uint32_t copies_checked;
+    uint32_t copies_corrupt;  // checks which failed, a copy counts again on every pass it fails
+    uint64_t bytes_read;
+} flash_scrub_stats_t;
+
 flash_status_t flash_init(flash_config_t* flash_config_ptr);
+void flash_deinit(void);
 flash_status_t flash_write(void);
 flash_status_t flash_read(void);
 
-static uint32_t flash_app_data_bytes_inc_meta(void);
+flash_status_t flash_versions(flash_version_info_t* info, uint32_t max_info, uint32_t* num_info);
+flash_status_t flash_read_version(uint32_t version, uint32_t offset, uint8_t* data, uint32_t num_bytes);
+flash_status_t flash_rollback(uint32_t version);
+
+// Checks about budget_bytes of the inactive copies, a copy header is read whole and may take
+// a call up to sizeof(app_data_meta_t) past the budget.
+// RETURNS: flash_status_data_corruption_detected when a copy failed its check during the call
+flash_status_t flash_scrub_step(uint32_t budget_bytes);
+flash_status_t flash_version_health(uint32_t version, flash_health_t* health);
+void flash_scrub_stats(flash_scrub_stats_t* stats);
 
-static bool flash_load_app_data_and_check_crc(uint32_t page_idx, app_data_meta_t * app_data_meta);
-static bool flash_read_copy_meta_data(uint32_t copy_idx, app_data_meta_t* app_meta_data);
+#ifdef __cplusplus
+}
+#endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,292 @@
+#ifndef FLASH_HPP
+#define FLASH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "flash.h"
+#include "flash_conf.h"
+
+/*
+    Header-only C++17 facade over flash.h.
+
+    A Layout describes the part as constexpr data, flash::Store<Layout, AppT> works out
+    the copy placement from it at compile time and hands it to flash_init as
+    flash_config_t.copy_layout, so a geometry which can't hold num_copies copies of AppT
+    (or unsorted pages, bad sectors..) is a compile error rather than a runtime status.
+
+    Layout requirements, all static constexpr members:
+        pages              std::array<page_dsc_t, N>, sorted by base_addr, not overlapping,
+                           at most FLASH_MAX_BANKS distinct bank ids
+        sectors            std::array<sector_dsc_t, M>, sorted by first_page_idx (M may be 0),
+                           sectors may nest within larger blocks
+        flash_keys         std::array<uint32_t, K> (K may be 0)
+        write_granularity  flash_write_size_t
+        num_copies         uint32_t, 2..CFG_APP_DATA_MAX_COPIES, with several banks a multiple
+                           of the bank count (or less than it) so every bank holds as many copies
+
+    e.g.
+        struct Layout
+        {
+            static constexpr std::array<page_dsc_t, 2> pages = {{ { 0x08020000, 0x20000, 0 }, { 0x08040000, 0x20000, 0 } }};
+            static constexpr std::array<sector_dsc_t, 0> sectors = {};
+            static constexpr std::array<uint32_t, 0> flash_keys = {};
+            static constexpr flash_write_size_t write_granularity = write_size_32bit;
+            static constexpr uint32_t num_copies = 2;
+        };
+        flash::Store<Layout, Settings> store;
+        store.init();
+        store.data().volume = 3;
+        store.commit();
+
+    The flash module holds a single configuration, so only one Store may be live at a time.
+*/
+
+namespace flash
+{
+
+namespace detail
+{
+
+template <std::size_t NumCopies>
+struct CopyPlan
+{
+    std::array<flash_copy_span_t, NumCopies> spans;
+    bool fits;
+    bool balanced;  // every bank holding copies holds as many as the others
+};
+
+// Same walk as flash_init with num_banks set to every bank of the pages: copies are dealt
+// round-robin over the banks (in order of first appearance), each takes whole contiguous
+// pages of its bank until it holds copy_num_bytes. Run at compile time, so all pages are looked at
+template <std::size_t NumCopies, std::size_t NumPages>
+constexpr CopyPlan<NumCopies> plan_copies(const std::array<page_dsc_t, NumPages>& pages, uint64_t copy_num_bytes)
+{
+    CopyPlan<NumCopies> plan{};
+    plan.fits = true;
+    plan.balanced = true;
+
+    std::array<uint32_t, FLASH_MAX_BANKS> banks{};
+    std::array<std::size_t, FLASH_MAX_BANKS> bank_page_idx{};
+    std::size_t num_banks = 0;
+    for (std::size_t page_idx = 0; page_idx < NumPages; ++page_idx)
+    {
+        std::size_t bank_num = 0;
+        while ((bank_num < num_banks) && (banks[bank_num] != pages[page_idx].bank))
+        {
+            ++bank_num;
+        }
+        if (bank_num == num_banks)
+        {
+            if (num_banks == FLASH_MAX_BANKS)
+            {
+                plan.fits = false;
+                return plan;
+            }
+            banks[num_banks++] = pages[page_idx].bank;
+        }
+    }
+
+    plan.balanced = (NumCopies < num_banks) || ((NumCopies % num_banks) == 0);
+
+    for (std::size_t copy_num = 0; copy_num < NumCopies; ++copy_num)
+    {
+        std::size_t bank_num = copy_num % num_banks;
+        std::size_t& page_idx = bank_page_idx[bank_num];
+        uint64_t bytes_spanned = 0;
+        std::size_t base_page_idx = page_idx;
+
+        while ((bytes_spanned < copy_num_bytes) && (page_idx < NumPages))
+        {
+            const page_dsc_t& page = pages[page_idx++];
+            if (page.bank != banks[bank_num])
+            {
+                base_page_idx = page_idx;
+                bytes_spanned = 0;
+                continue;
+            }
+
+            // A copy is addressed as one range, restart it past a gap in the address map
+            if ((bytes_spanned > 0) &&
+                ((uint64_t)pages[page_idx - 2].base_addr + pages[page_idx - 2].size_bytes != page.base_addr))
+            {
+                base_page_idx = page_idx - 1;
+                bytes_spanned = 0;
+            }
+            bytes_spanned += page.size_bytes;
+        }
+
+        if (bytes_spanned < copy_num_bytes)
+        {
+            plan.fits = false;
+            return plan;
+        }
+
+        plan.spans[copy_num].base_page_idx = static_cast<uint32_t>(base_page_idx);
+        plan.spans[copy_num].num_pages     = static_cast<uint32_t>(page_idx - base_page_idx);
+    }
+
+    return plan;
+}
+
+// Same rules as page_table_init
+template <std::size_t NumPages>
+constexpr bool pages_valid(const std::array<page_dsc_t, NumPages>& pages)
+{
+    for (std::size_t idx = 0; idx < NumPages; ++idx)
+    {
+        if (pages[idx].size_bytes == 0)
+        {
+            return false;
+        }
+        if ((idx > 0) && ((uint64_t)pages[idx - 1].base_addr + pages[idx - 1].size_bytes > pages[idx].base_addr))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <std::size_t NumSectors>
+constexpr bool sectors_valid(const std::array<sector_dsc_t, NumSectors>& sectors, std::size_t num_pages)
+{
+    for (std::size_t idx = 0; idx < NumSectors; ++idx)
+    {
+        if ((sectors[idx].num_pages == 0) ||
+            ((uint64_t)sectors[idx].first_page_idx + sectors[idx].num_pages > num_pages))
+        {
+            return false;
+        }
+        // Sectors may overlap or nest (a sector within a larger block), as ll_flash_init allows
+        if ((idx > 0) && (sectors[idx - 1].first_page_idx > sectors[idx].first_page_idx))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace detail
+
+template <typename Layout, typename AppT>
+class Store
+{
+public:
+    static constexpr uint32_t num_copies     = Layout::num_copies;
+    static constexpr uint32_t copy_num_bytes = sizeof(app_data_meta_t) + sizeof(AppT);
+
+    static_assert(std::is_trivially_copyable<AppT>::value, "AppT is stored as raw bytes, it must be trivially copyable");
+    static_assert((num_copies >= 2) && (num_copies <= CFG_APP_DATA_MAX_COPIES),
+                  "num_copies out of range, a commit needs a copy besides the active one");
+    static_assert(Layout::pages.size() > 0, "Layout has no pages");
+    static_assert(detail::pages_valid(Layout::pages), "pages must be sorted by base_addr, non-empty and not overlap");
+    static_assert(detail::sectors_valid(Layout::sectors, Layout::pages.size()),
+                  "sectors must be sorted by first_page_idx, non-empty and within the pages");
+
+    static constexpr detail::CopyPlan<num_copies> plan =
+        detail::plan_copies<num_copies>(Layout::pages, copy_num_bytes);
+    static_assert(plan.fits, "num_copies copies of AppT (plus meta data) do not fit in the described pages (or banks)");
+    static_assert(plan.balanced, "num_copies must split evenly over the banks, else the smaller share wears faster");
+
+    Store()
+    {
+        config_.num_app_data_copies = num_copies;
+        config_.copy_layout         = plan.spans.data();
+
+        config_.data_descriptor.app_data       = reinterpret_cast<uint8_t*>(&data_);
+        config_.data_descriptor.data_num_bytes = sizeof(AppT);
+
+        config_.ll.num_flash_keys     = static_cast<uint8_t>(Layout::flash_keys.size());
+        config_.ll.flash_keys         = Layout::flash_keys.data();
+        config_.ll.write_granularity  = Layout::write_granularity;
+        config_.ll.pages_total_num    = static_cast<uint32_t>(Layout::pages.size());
+        config_.ll.page_descriptors   = Layout::pages.data();
+        config_.ll.sectors_total_num  = static_cast<uint32_t>(Layout::sectors.size());
+        config_.ll.sector_descriptors = Layout::sectors.data();
+    }
+
+    ~Store()
+    {
+        flash_deinit();
+    }
+
+    Store(const Store&) = delete;
+    Store& operator=(const Store&) = delete;
+
+    // Algorithm for new commits, takes effect on init (NULL = CRC32)
+    void set_integrity(const flash_integrity_t* integrity, const flash_integrity_t* const* known = nullptr,
+                       uint32_t num_known = 0)
+    {
+        config_.integrity          = integrity;
+        config_.integrity_algs     = known;
+        config_.num_integrity_algs = num_known;
+    }
+
+    // Loads the latest good version into data()
+    flash_status_t init()
+    {
+        return flash_init(&config_);
+    }
+
+    AppT& data() { return data_; }
+    const AppT& data() const { return data_; }
+
+    // Commits data() as a new version
+    flash_status_t commit()
+    {
+        return flash_write();
+    }
+
+    flash_status_t write(const AppT& value)
+    {
+        data_ = value;
+        return flash_write();
+    }
+
+    // Reloads the active version into data() and copies it out
+    flash_status_t read(AppT& value)
+    {
+        flash_status_t status = flash_read();
+        if (status == flash_status_ok)
+        {
+            value = data_;
+        }
+        return status;
+    }
+
+    flash_status_t read_version(uint32_t version, AppT& value) const
+    {
+        return flash_read_version(version, 0, reinterpret_cast<uint8_t*>(&value), sizeof(AppT));
+    }
+
+    flash_status_t rollback(uint32_t version)
+    {
+        return flash_rollback(version);
+    }
+
+    // Checks about budget_bytes of the inactive versions, see flash_scrub_step
+    flash_status_t scrub_step(uint32_t budget_bytes)
+    {
+        return flash_scrub_step(budget_bytes);
+    }
+
+    flash_status_t health(uint32_t version, flash_health_t& health) const
+    {
+        return flash_version_health(version, &health);
+    }
+
+    template <std::size_t MaxInfo>
+    flash_status_t versions(std::array<flash_version_info_t, MaxInfo>& info, uint32_t& num_info) const
+    {
+        return flash_versions(info.data(), static_cast<uint32_t>(MaxInfo), &num_info);
+    }
+
+private:
+    AppT data_{};
+    flash_config_t config_{};
+};
+
+} // namespace flash
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef FLASH_INTEGRITY_H
+#define FLASH_INTEGRITY_H
+
+#include <stdint.h>
+#include "xxh64.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+    Integrity algorithms used to check app_data copies.
+
+    An algorithm is a streaming begin / update / final triple plus an id. The id is
+    recorded in the header of every copy it commits, so a copy is always verified
+    with the algorithm that wrote it, whatever the current configuration picks for
+    new commits. 32-bit algorithms return their value zero extended.
+
+    Built-in ids are 1..0x7F, deployment specific algorithms (e.g. an MCU CRC unit)
+    take ids from FLASH_INTEGRITY_ID_USER up. 0 and 0xFFFFFFFF (erased) are never valid.
+*/
+
+#define FLASH_INTEGRITY_ID_CRC32  1
+#define FLASH_INTEGRITY_ID_CRC32C 2
+#define FLASH_INTEGRITY_ID_XXH64  3
+#define FLASH_INTEGRITY_ID_USER   0x80
+
+// Running state, big enough for every built-in, custom algorithms use the raw words
+typedef union
+{
+    uint32_t crc;
+    xxh64_state_t xxh64;
+    uint64_t words[12];
+} flash_integrity_state_t;
+
+typedef struct
+{
+    uint32_t id;
+    const char* name;
+    void (*begin)(flash_integrity_state_t* state);
+    void (*update)(flash_integrity_state_t* state, const uint8_t* data, uint32_t num_bytes);
+    uint64_t (*final)(flash_integrity_state_t* state);
+} flash_integrity_t;
+
+extern const flash_integrity_t flash_integrity_crc32;   // default, matches crc32()
+extern const flash_integrity_t flash_integrity_crc32c;  // SSE4.2 crc32 instruction where available
+extern const flash_integrity_t flash_integrity_xxh64;   // 64-bit, seed 0
+
+// RETURNS: built-in algorithm with that id, else NULL
+const flash_integrity_t* flash_integrity_builtin(uint32_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
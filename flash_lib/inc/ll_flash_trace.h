@@ -0,0 +1,98 @@
+#ifndef LL_FLASH_TRACE_H
+#define LL_FLASH_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ll_flash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+    Tracing layer around the ll_flash_* calls made by the flash module.
+
+    The ll_trace_* wrappers forward to ll_flash_*, and while a trace is running
+    also emit one fixed size record per op to a caller supplied sink (file, UART,
+    RAM ring..). Timestamps come from a caller supplied free running tick counter.
+    Nothing is buffered or allocated, the sink sees each record as it completes.
+
+    Trace format (little endian, packed):
+        ll_trace_header_t
+        records, each an ll_trace_record_t. A geometry record (emitted on
+        ll_trace_init, or on ll_trace_start when init has already happened) is
+        followed by page_dsc_t[addr] and sector_dsc_t[num_bytes].
+
+    Record fields per op:
+        read / write   addr, num_bytes, hash = CRC32 of the data (hash_payloads only)
+        erase          addr = first page idx, num_bytes = page count
+        init           status only
+    start is the tick count when the op was issued, duration its length in ticks.
+*/
+
+#define LL_TRACE_MAGIC   0x3154544CUL // "LLT1"
+#define LL_TRACE_VERSION 2 // 2: page_dsc_t carries a bank id
+
+#define LL_TRACE_FLAG_HASHES 0x1UL
+
+typedef enum
+{
+    ll_trace_op_geometry,
+    ll_trace_op_init,
+    ll_trace_op_read,
+    ll_trace_op_write,
+    ll_trace_op_erase,
+} ll_trace_op_t;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_num_bytes;
+    uint32_t clock_hz;  // 0 when no clock was supplied
+    uint32_t flags;
+} ll_trace_header_t;
+
+typedef struct __attribute__((packed))
+{
+    uint8_t  op;        // ll_trace_op_t
+    uint8_t  status;    // ll_flash_status_t returned
+    uint16_t aux;       // geometry: write_granularity
+    uint32_t addr;
+    uint32_t num_bytes;
+    uint32_t start;
+    uint32_t duration;
+    uint32_t hash;
+} ll_trace_record_t;
+
+typedef void (*ll_trace_sink_t)(const uint8_t* bytes, uint32_t num_bytes, void* ctx);
+typedef uint32_t (*ll_trace_clock_t)(void);
+
+typedef struct
+{
+    ll_trace_sink_t sink;
+    void* sink_ctx;
+    ll_trace_clock_t clock;  // NULL records zero timestamps
+    uint32_t clock_hz;
+    bool hash_payloads;      // CRC32 of the data of every read / write
+} ll_trace_config_t;
+
+/*
+    Starts a trace, emits the header (and the geometry if ll_trace_init has run).
+    A running trace is stopped first.
+*/
+void ll_trace_start(const ll_trace_config_t* config);
+void ll_trace_stop(void);
+bool ll_trace_active(void);
+
+ll_flash_status_t ll_trace_init(ll_flash_config_t* ll_config);
+ll_flash_status_t ll_trace_read(uint32_t addr, uint8_t* data, uint32_t num_bytes);
+ll_flash_status_t ll_trace_write(uint32_t addr, const uint8_t* data, uint32_t num_bytes);
+ll_flash_status_t ll_trace_writev(uint32_t addr, const ll_flash_iovec_t* iov, uint32_t iov_count);
+ll_flash_status_t ll_trace_range_erase(uint32_t first_page_idx, uint32_t page_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
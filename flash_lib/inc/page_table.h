@@ -0,0 +1,61 @@
+#ifndef PAGE_TABLE_H
+#define PAGE_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ll_flash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+    Address -> page resolution over an array of page descriptors.
+
+    Descriptors must be sorted by ascending base_addr and must not overlap,
+    gaps between pages are allowed. Lookup is O(1) when every page has the
+    same size and pages are back to back, else a binary search, O(log n).
+    The table references the descriptor array, it is not copied.
+*/
+
+typedef struct
+{
+    const page_dsc_t* pages;
+    uint32_t num_pages;
+    uint32_t uniform_page_size; // 0 unless pages are contiguous and equally sized
+} page_table_t;
+
+/*
+    Validates ordering and detects uniform geometry.
+    RETURNS: True on success, else False (unsorted, overlapping or zero sized pages)
+*/
+bool page_table_init(page_table_t* table, const page_dsc_t* pages, uint32_t num_pages);
+
+/*
+    Finds the page holding addr, page_offset is set to the offset of addr within it.
+    RETURNS: True on success, else False (addr not within any page)
+*/
+bool page_table_lookup(const page_table_t* table, uint32_t addr, uint32_t* page_idx, uint32_t* page_offset);
+
+/*
+    Index of the first sector starting at first_page_idx, sectors must be sorted by
+    ascending first_page_idx (several may start on the same page, e.g. sector and block).
+    RETURNS: num_sectors when no sector starts at first_page_idx
+*/
+uint32_t page_table_sector_lower_bound(const sector_dsc_t* sectors, uint32_t num_sectors, uint32_t first_page_idx);
+
+/*
+    RETURNS: True when the pages are back to back in the address map (no gaps)
+*/
+bool page_table_is_contiguous(const page_dsc_t* pages, uint32_t num_pages);
+
+/*
+    RETURNS: True when the pages all sit in the same bank
+*/
+bool page_table_is_one_bank(const page_dsc_t* pages, uint32_t num_pages);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
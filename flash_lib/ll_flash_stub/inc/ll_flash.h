@@ -3,14 +3,27 @@
 
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct 
 {
     // Assign to externs from
     // linker script values
     uint32_t base_addr;
     uint32_t size_bytes;
+    uint32_t bank;      // read-while-write bank, 0 on single bank parts
 } page_dsc_t;
 
+// Consecutive pages the part erases as one operation (sector, block, bank..).
+// Descriptor arrays are sorted, pages by base_addr and sectors by first_page_idx.
+typedef struct
+{
+    uint32_t first_page_idx;
+    uint32_t num_pages;
+} sector_dsc_t;
+
 typedef enum
 {
     write_size_8bit,
@@ -27,8 +40,17 @@ typedef struct
     flash_write_size_t write_granularity;
     const uint32_t* flash_keys;
     const page_dsc_t* page_descriptors;
+    uint32_t sectors_total_num;             // 0 when only page erase is available
+    const sector_dsc_t* sector_descriptors;
 } ll_flash_config_t;
 
+// One source buffer of a vectored write
+typedef struct
+{
+    const uint8_t* data;
+    uint32_t num_bytes;
+} ll_flash_iovec_t;
+
 typedef enum
 {
     ll_flash_status_ok,
@@ -36,8 +58,17 @@ typedef enum
 } ll_flash_status_t;
 
 ll_flash_status_t ll_flash_init(ll_flash_config_t* _ll_flash_ptr);
-ll_flash_status_t ll_flash_write(uint32_t addr, uint8_t* data, uint32_t size);
+ll_flash_status_t ll_flash_write(uint32_t addr, const uint8_t* data, uint32_t size);
+// Programs iov buffers back to back from addr as a single transaction
+ll_flash_status_t ll_flash_writev(uint32_t addr, const ll_flash_iovec_t* iov, uint32_t iov_count);
 ll_flash_status_t ll_flash_read(uint32_t addr, uint8_t* data, uint32_t size);
-ll_flash_status_t ll_flash_page_erase(uint8_t page_idx);
+ll_flash_status_t ll_flash_page_erase(uint32_t page_idx);
+// Erases page_count pages from first_page_idx as one operation, the range must be
+// a single page or exactly one of the described sectors
+ll_flash_status_t ll_flash_range_erase(uint32_t first_page_idx, uint32_t page_count);
+
+#ifdef __cplusplus
+}
+#endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,180 @@
+#ifndef LL_FLASH_STUB_H
+#define LL_FLASH_STUB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+    Host-only controls for the ll_flash stub.
+    Real ll drivers do not provide these, only test harnesses should include this.
+*/
+
+/*
+    Enables / disables nv_state file persistence (enabled by default).
+    With persistence disabled ll_flash_init keeps the in-memory image
+    across re-inits and ll_flash_write / ll_flash_page_erase never touch disk.
+*/
+void ll_flash_stub_set_persistence(bool enable);
+
+/*
+    Flat copy of the faux flash image, pages back to back in descriptor order.
+    Pages which are all 0xFF on import are held as erased (no backing memory).
+    RETURNS: True on success, else False (e.g. lazily loaded page failed its CRC)
+*/
+uint32_t ll_flash_stub_image_num_bytes(void);
+bool ll_flash_stub_image_export(uint8_t* image);
+bool ll_flash_stub_image_import(const uint8_t* image);
+
+/*
+    Number of pages currently backed by memory (programmed or loaded).
+*/
+uint32_t ll_flash_stub_num_resident_pages(void);
+
+/*
+    Page memory allocator. The stub sizes the device from the page descriptors on
+    ll_flash_init (reserve, with the sum of the page sizes), then allocates each page
+    when first programmed or loaded at its device offset, the page's position were the
+    pages packed back to back in descriptor order. Address gaps between pages cost
+    nothing, region allocators simply return base + device_offset.
+    Setting an allocator drops the current image (the old one is told reserve(0) so it
+    can let go of any region), call it before ll_flash_init.
+
+    heap   malloc per page, memory follows the pages in use (default)
+    arena  caller supplied buffer of at least the device size (static, no heap)
+    mmap   one anonymous mapping of the device size, committed by the OS as pages are
+           touched, optionally transparent hugepage backed (Linux) for large parts
+*/
+typedef struct
+{
+    bool  (*reserve)(void* ctx, size_t device_num_bytes);
+    void* (*alloc)(void* ctx, size_t device_offset, size_t num_bytes);
+    void  (*release)(void* ctx, void* data, size_t device_offset, size_t num_bytes);
+    void* ctx;
+} ll_flash_stub_allocator_t;
+
+typedef struct
+{
+    uint8_t* base;
+    size_t num_bytes;
+} ll_flash_stub_arena_t;
+
+void ll_flash_stub_set_allocator(const ll_flash_stub_allocator_t* allocator);
+
+ll_flash_stub_allocator_t ll_flash_stub_heap_allocator(void);
+ll_flash_stub_allocator_t ll_flash_stub_arena_allocator(ll_flash_stub_arena_t* arena);
+ll_flash_stub_allocator_t ll_flash_stub_mmap_allocator(bool huge_pages);
+
+/*
+    Program semantics. The default overwrites like memcpy. NOR mode ANDs programmed
+    data into the current contents, so bits only go 1->0 until the next erase, and
+    counts each bit a program tried to take 0->1. once_per_word additionally counts
+    programs into a write_granularity word already programmed since its erase (parts
+    with ECC / one-shot words). With strict set such programs fail (the AND is still
+    applied), else they are only counted.
+*/
+typedef struct
+{
+    bool nor;
+    bool once_per_word;
+    bool strict;
+} ll_flash_stub_program_mode_t;
+
+typedef struct
+{
+    uint64_t bits_set_without_erase;
+    uint64_t words_reprogrammed;
+    uint64_t programs_failed;  // strict mode only
+} ll_flash_stub_program_stats_t;
+
+void ll_flash_stub_set_program_mode(const ll_flash_stub_program_mode_t* mode);
+void ll_flash_stub_program_stats(ll_flash_stub_program_stats_t* stats);
+void ll_flash_stub_clear_program_stats(void);
+
+/*
+    Wear counters per page, for endurance simulation. An erase counts against every
+    page it reaches (a power cut part way through still wears the pages it touched).
+    Counters live with the in-memory device: they survive re-inits while persistence
+    is disabled, are not saved to nv_state and restart at zero on a new geometry.
+    RETURNS: False for a page_idx outside the device
+*/
+typedef struct
+{
+    uint64_t erase_count;
+    uint64_t program_ops;       // program ops which reached the page
+    uint64_t bytes_programmed;
+} ll_flash_stub_page_wear_t;
+
+bool ll_flash_stub_page_wear(uint32_t page_idx, ll_flash_stub_page_wear_t* wear);
+void ll_flash_stub_clear_wear(void);
+
+/*
+    Read-while-write bank model, in virtual ticks. With a timing set program and erase
+    ops are posted: contents change at once, but each page's bank (page_dsc_t.bank) stays
+    busy until the op would have completed, and a later op on the same bank queues behind
+    it. A read of a busy bank stalls until the bank is idle and is counted against it,
+    reads of any other bank go straight through. Time moves only by ll_flash_stub_advance
+    and by stalls. The default (zeroed) timing completes every op at once, nothing is
+    ever busy and bank ids are not looked at. Setting a timing restarts the clock and
+    the counters. Bank ids need not be dense (e.g. 0, 1, 5), the first
+    LL_FLASH_STUB_MAX_BANKS distinct ids in page order are tracked, pages of any later
+    id are never busy.
+    RETURNS: False for a bank id which is not tracked
+*/
+#define LL_FLASH_STUB_MAX_BANKS 4
+
+typedef struct
+{
+    uint32_t erase_ticks_per_page;
+    uint32_t program_ticks_per_word;    // per write_granularity word
+} ll_flash_stub_bank_timing_t;
+
+typedef struct
+{
+    uint64_t ops;               // program / erase ops which reached the bank
+    uint64_t busy_ticks;
+    uint64_t reads_stalled;
+    uint64_t stall_ticks;
+} ll_flash_stub_bank_stats_t;
+
+void ll_flash_stub_set_bank_timing(const ll_flash_stub_bank_timing_t* timing);
+void ll_flash_stub_advance(uint64_t ticks);
+uint64_t ll_flash_stub_now(void);
+bool ll_flash_stub_bank_busy(uint32_t bank);
+bool ll_flash_stub_bank_stats(uint32_t bank, ll_flash_stub_bank_stats_t* stats);
+void ll_flash_stub_clear_bank_stats(void);
+
+/*
+    Power-loss fault injection.
+
+    Arms a power cut during the op_idx'th (zero based, counted from arming)
+    program or erase op. Only the first byte_offset bytes of that op reach the
+    flash, the op and every following program / erase fail without effect
+    until ll_flash_stub_clear_power_cut is called (faux reboot).
+*/
+typedef enum
+{
+    ll_flash_stub_op_program,
+    ll_flash_stub_op_erase,
+} ll_flash_stub_op_t;
+
+void ll_flash_stub_set_power_cut(uint32_t op_idx, uint32_t byte_offset);
+void ll_flash_stub_clear_power_cut(void);
+bool ll_flash_stub_power_lost(void);
+
+/*
+    Observer called on every program / erase op before it is applied,
+    addr is relative to page_descriptors[0].base_addr. NULL disables.
+*/
+typedef void (*ll_flash_stub_op_hook_t)(ll_flash_stub_op_t op, uint32_t addr, uint32_t num_bytes);
+void ll_flash_stub_set_op_hook(ll_flash_stub_op_hook_t hook);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
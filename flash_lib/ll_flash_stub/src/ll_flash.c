@@ -1,21 +1,811 @@
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include "ll_flash.h"
+#include "ll_flash_stub.h"
+#include "page_table.h"
 #include "file_io.h"
+#include "crc.h"
 
-#define FLASH_SIZE 1024UL*128UL*4UL //4 PAGES OF 128K
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+    Stub ll flash driver, faux flash held in RAM.
+
+    Memory is held per page and only allocated once a page is programmed or
+    loaded, erased pages read as 0xFF without any backing memory. Startup and
+    memory cost scale with the pages actually used, not the device size.
+    Page memory comes from a pluggable allocator (heap by default, or a static
+    arena / mmap region sized from the page descriptors), see ll_flash_stub.h.
+
+    nv_state image format (persistence enabled):
+        nv_image_header_t
+        nv_image_page_t[num_pages]  geometry, ERASED / VALID flag and CRC32 per page
+        page data, each page at a fixed offset following the page table
+    Only programmed pages are written, erased pages stay as holes in the file.
+    ll_flash_init reads the header and page table only, page data is loaded
+    (and CRC checked) on first access.
+
+    Banks are modelled for read-while-write parts: with a timing set, program and
+    erase ops keep their bank busy for a while on a virtual clock and reads of a
+    busy bank stall, see ll_flash_stub_set_bank_timing.
+
+    Programs overwrite by default. In NOR mode they AND into the existing
+    contents and count 0->1 attempts, 64 bytes per step as four SSE2
+    registers (a popcount only for steps which tried a 0->1), then 8 bytes
+    at a time for the tail, or throughout without SSE2. With once_per_word
+    a bitmap per page tracks which words have been programmed since their
+    erase. The bitmap is built from the page contents (non 0xFF words) on
+    first use, so it needs no persisting.
+*/
+
+#define NV_IMAGE_MAGIC   0x3153564EUL // "NVS1"
+#define NV_IMAGE_VERSION 1UL
+
+#define NV_PAGE_ERASED 0x1UL
+#define NV_PAGE_VALID  0x2UL
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_pages;
+    uint32_t reserved;
+} nv_image_header_t;
+
+typedef struct
+{
+    uint32_t base_addr;
+    uint32_t size_bytes;
+    uint32_t flags;
+    uint32_t crc32;
+    uint64_t file_offset;
+} nv_image_page_t;
+
+typedef struct
+{
+    uint8_t* data;      // NULL until the page is first programmed or loaded
+    bool erased;        // reads as 0xFF, any data held is stale
+    bool loaded;        // false: contents only in nv_state so far
+    uint8_t* programmed; // once_per_word: bit per word programmed since erase, NULL until needed
+    size_t device_offset; // position with the pages packed in descriptor order, for the allocator
+    ll_flash_stub_page_wear_t wear;
+    nv_image_page_t nv; // page table entry as held in nv_state
+} stub_page_t;
 
 ll_flash_config_t* ll_flash_ptr = NULL;
-uint8_t mem[FLASH_SIZE];
+
+static stub_page_t* pages = NULL;
+static uint32_t num_pages = 0;
+static page_table_t page_table;
+
+static ll_flash_stub_allocator_t allocator;
+static bool allocator_set = false;
+
+static bool persist = true;
+static bool nv_header_saved = false;
+
+static ll_flash_stub_program_mode_t program_mode; // zeroed: overwrite
+static ll_flash_stub_program_stats_t program_stats;
+
+// Read-while-write model, each bank is busy until busy_until on the virtual clock.
+// Bank ids are sparse (e.g. 0, 1, 5), state is kept per slot, ids[slot] in order of
+// first appearance in the page descriptors (as flash_init deals its copies).
+static struct {
+    ll_flash_stub_bank_timing_t timing; // zeroed: ops complete at once
+    bool enabled;                       // timing is non-zero
+    uint64_t now;
+    uint32_t ids[LL_FLASH_STUB_MAX_BANKS];
+    uint32_t num_ids;
+    uint64_t busy_until[LL_FLASH_STUB_MAX_BANKS];
+    ll_flash_stub_bank_stats_t stats[LL_FLASH_STUB_MAX_BANKS];
+} banks;
+
+// Power-loss fault injection, counts program + erase ops since arming
+static struct {
+    bool armed;
+    bool power_lost;
+    uint32_t op_count;
+    uint32_t cut_op_idx;
+    uint32_t cut_byte_offset;
+    ll_flash_stub_op_hook_t hook;
+} fault;
+
+// Returns number of bytes of the op which reach the flash before power is
+// lost, num_bytes if the op completes. Sets power_lost when the cut fires.
+static uint32_t fault_bytes_applied(ll_flash_stub_op_t op, uint32_t addr, uint32_t num_bytes)
+{
+    if(fault.hook != NULL)
+    {
+        fault.hook(op, addr - ll_flash_ptr->page_descriptors[0].base_addr, num_bytes);
+    }
+
+    if(fault.power_lost)
+    {
+        return 0;
+    }
+
+    if(fault.armed && (fault.op_count++ == fault.cut_op_idx))
+    {
+        fault.power_lost = true;
+        return (fault.cut_byte_offset < num_bytes) ? fault.cut_byte_offset : num_bytes;
+    }
+
+    return num_bytes;
+}
+
+void ll_flash_stub_set_power_cut(uint32_t op_idx, uint32_t byte_offset)
+{
+    fault.armed           = true;
+    fault.power_lost      = false;
+    fault.op_count        = 0;
+    fault.cut_op_idx      = op_idx;
+    fault.cut_byte_offset = byte_offset;
+}
+
+void ll_flash_stub_clear_power_cut(void)
+{
+    fault.armed      = false;
+    fault.power_lost = false;
+    fault.op_count   = 0;
+}
+
+bool ll_flash_stub_power_lost(void)
+{
+    return fault.power_lost;
+}
+
+void ll_flash_stub_set_op_hook(ll_flash_stub_op_hook_t hook)
+{
+    fault.hook = hook;
+}
+
+void ll_flash_stub_set_persistence(bool enable)
+{
+    persist = enable;
+}
+
+void ll_flash_stub_set_program_mode(const ll_flash_stub_program_mode_t* mode)
+{
+    assert(mode != NULL);
+    program_mode = *mode;
+}
+
+void ll_flash_stub_program_stats(ll_flash_stub_program_stats_t* stats)
+{
+    assert(stats != NULL);
+    *stats = program_stats;
+}
+
+void ll_flash_stub_clear_program_stats(void)
+{
+    memset(&program_stats, 0, sizeof(program_stats));
+}
+
+void ll_flash_stub_set_bank_timing(const ll_flash_stub_bank_timing_t* timing)
+{
+    assert(timing != NULL);
+
+    // The id map belongs to the geometry, it outlives a new timing
+    memset(&banks.busy_until, 0, sizeof(banks.busy_until));
+    memset(&banks.stats, 0, sizeof(banks.stats));
+    banks.now     = 0;
+    banks.timing  = *timing;
+    banks.enabled = (timing->erase_ticks_per_page != 0) || (timing->program_ticks_per_word != 0);
+}
+
+void ll_flash_stub_advance(uint64_t ticks)
+{
+    banks.now += ticks;
+}
+
+uint64_t ll_flash_stub_now(void)
+{
+    return banks.now;
+}
+
+// RETURNS: slot of a bank id, LL_FLASH_STUB_MAX_BANKS for an id no page carries (or one past the tracked banks)
+static uint32_t bank_slot(uint32_t bank)
+{
+    for(uint32_t slot = 0; slot < banks.num_ids; ++slot)
+    {
+        if(banks.ids[slot] == bank)
+        {
+            return slot;
+        }
+    }
+    return LL_FLASH_STUB_MAX_BANKS;
+}
+
+// Maps the bank ids of the configured pages to slots, ids past LL_FLASH_STUB_MAX_BANKS go untracked
+static void bank_map(void)
+{
+    banks.num_ids = 0;
+    for(uint32_t page_idx = 0; page_idx < ll_flash_ptr->pages_total_num; ++page_idx)
+    {
+        uint32_t bank = ll_flash_ptr->page_descriptors[page_idx].bank;
+        if((bank_slot(bank) == LL_FLASH_STUB_MAX_BANKS) && (banks.num_ids < LL_FLASH_STUB_MAX_BANKS))
+        {
+            banks.ids[banks.num_ids++] = bank;
+        }
+    }
+}
+
+bool ll_flash_stub_bank_busy(uint32_t bank)
+{
+    uint32_t slot = bank_slot(bank);
+    return (slot < LL_FLASH_STUB_MAX_BANKS) && (banks.busy_until[slot] > banks.now);
+}
+
+bool ll_flash_stub_bank_stats(uint32_t bank, ll_flash_stub_bank_stats_t* stats)
+{
+    assert(stats != NULL);
+
+    uint32_t slot = bank_slot(bank);
+    if(slot == LL_FLASH_STUB_MAX_BANKS)
+    {
+        return false;
+    }
+    *stats = banks.stats[slot];
+    return true;
+}
+
+void ll_flash_stub_clear_bank_stats(void)
+{
+    memset(banks.stats, 0, sizeof(banks.stats));
+}
+
+// Posts a program / erase of ticks on the page's bank, queued behind whatever it is busy with.
+// Nothing to do without a timing, and untracked banks are never busy.
+static void bank_post(uint32_t page_idx, uint64_t ticks)
+{
+    uint32_t slot = banks.enabled ? bank_slot(ll_flash_ptr->page_descriptors[page_idx].bank) : LL_FLASH_STUB_MAX_BANKS;
+    if(slot == LL_FLASH_STUB_MAX_BANKS)
+    {
+        return;
+    }
+    uint64_t start = (banks.busy_until[slot] > banks.now) ? banks.busy_until[slot] : banks.now;
+
+    banks.busy_until[slot] = start + ticks;
+    banks.stats[slot].busy_ticks += ticks;
+    ++banks.stats[slot].ops;
+}
+
+// A read waits for the page's bank to finish its posted ops
+static void bank_read_wait(uint32_t page_idx)
+{
+    uint32_t slot = banks.enabled ? bank_slot(ll_flash_ptr->page_descriptors[page_idx].bank) : LL_FLASH_STUB_MAX_BANKS;
+    if((slot < LL_FLASH_STUB_MAX_BANKS) && (banks.busy_until[slot] > banks.now))
+    {
+        ++banks.stats[slot].reads_stalled;
+        banks.stats[slot].stall_ticks += banks.busy_until[slot] - banks.now;
+        banks.now = banks.busy_until[slot];
+    }
+}
+
+// Finds the page holding addr
+static uint32_t page_lookup(uint32_t addr, uint32_t* page_offset)
+{
+    uint32_t page_idx;
+    if(!page_table_lookup(&page_table, addr, &page_idx, page_offset))
+    {
+        assert(0); // Address outside of described flash
+        return num_pages;
+    }
+    return page_idx;
+}
+
+static const ll_flash_stub_allocator_t* page_allocator(void)
+{
+    if(!allocator_set)
+    {
+        allocator     = ll_flash_stub_heap_allocator();
+        allocator_set = true;
+    }
+    return &allocator;
+}
+
+// Frees every page, the device is gone until the next pages_reset
+static void pages_free(void)
+{
+    const ll_flash_stub_allocator_t* alloc = page_allocator();
+    for(uint32_t page_idx = 0; page_idx < num_pages; ++page_idx)
+    {
+        stub_page_t* page = &pages[page_idx];
+        if(page->data != NULL)
+        {
+            alloc->release(alloc->ctx, page->data, page->device_offset, page->nv.size_bytes);
+        }
+        free(page->programmed);
+    }
+    free(pages);
+    pages     = NULL;
+    num_pages = 0;
+}
+
+// Drops all page memory and sets up an erased device of the configured geometry.
+// RETURNS: false if the allocator can't hold a device of that size
+static bool pages_reset(void)
+{
+    pages_free();
+
+    num_pages = ll_flash_ptr->pages_total_num;
+    pages = calloc(num_pages, sizeof(stub_page_t));
+    assert(pages != NULL);
+
+    uint64_t file_offset = sizeof(nv_image_header_t) + (uint64_t)num_pages * sizeof(nv_image_page_t);
+    size_t device_offset = 0;
+    for(uint32_t page_idx = 0; page_idx < num_pages; ++page_idx)
+    {
+        stub_page_t* page = &pages[page_idx];
+        page->erased         = true;
+        page->loaded         = true;
+        page->device_offset  = device_offset;
+        page->nv.base_addr   = ll_flash_ptr->page_descriptors[page_idx].base_addr;
+        page->nv.size_bytes  = ll_flash_ptr->page_descriptors[page_idx].size_bytes;
+        page->nv.flags       = NV_PAGE_ERASED;
+        page->nv.crc32       = 0;
+        page->nv.file_offset = file_offset;
+        file_offset   += page->nv.size_bytes;
+        device_offset += page->nv.size_bytes;
+    }
+
+    nv_header_saved = false;
+
+    const ll_flash_stub_allocator_t* alloc = page_allocator();
+    if(!alloc->reserve(alloc->ctx, device_offset))
+    {
+        printf("ll_flash:pages_reset: allocator can't hold a %zu byte device\n", device_offset);
+        pages_free();
+        return false;
+    }
+    return true;
+}
+
+// Backing memory for a page, NULL if the allocator is out of room
+static uint8_t* page_alloc(stub_page_t* page)
+{
+    if(page->data == NULL)
+    {
+        const ll_flash_stub_allocator_t* alloc = page_allocator();
+        page->data = alloc->alloc(alloc->ctx, page->device_offset, page->nv.size_bytes);
+    }
+    return page->data;
+}
+
+void ll_flash_stub_set_allocator(const ll_flash_stub_allocator_t* new_allocator)
+{
+    assert(new_allocator != NULL);
+    assert((new_allocator->reserve != NULL) && (new_allocator->alloc != NULL) && (new_allocator->release != NULL));
+
+    const ll_flash_stub_allocator_t* alloc = page_allocator();
+    pages_free();
+    alloc->reserve(alloc->ctx, 0);
+
+    allocator     = *new_allocator;
+    allocator_set = true;
+}
+
+// Reads the nv_state header + page table, page data is left for first access
+static bool nv_load_page_table(void)
+{
+    nv_image_header_t header;
+    if(!load_state_at(0, (uint8_t*)&header, sizeof(header)))
+    {
+        return false;
+    }
+
+    if((header.magic != NV_IMAGE_MAGIC) || (header.version != NV_IMAGE_VERSION) || (header.num_pages != num_pages))
+    {
+        printf("ll_flash:nv_load_page_table: nv_state format or geometry mismatch\n");
+        return false;
+    }
+
+    // Whole page table in one read, a file open per entry adds up with thousands of pages
+    nv_image_page_t* entries = malloc((size_t)num_pages * sizeof(nv_image_page_t));
+    assert(entries != NULL);
+    if(!load_state_at(sizeof(header), (uint8_t*)entries, num_pages * sizeof(nv_image_page_t)))
+    {
+        free(entries);
+        return false;
+    }
+
+    for(uint32_t page_idx = 0; page_idx < num_pages; ++page_idx)
+    {
+        const nv_image_page_t* entry = &entries[page_idx];
+        stub_page_t* page = &pages[page_idx];
+        if((entry->base_addr != page->nv.base_addr) || (entry->size_bytes != page->nv.size_bytes) ||
+           (entry->file_offset != page->nv.file_offset))
+        {
+            printf("ll_flash:nv_load_page_table: page %u geometry mismatch\n", page_idx);
+            free(entries);
+            return false;
+        }
+
+        page->nv     = *entry;
+        page->erased = (entry->flags & NV_PAGE_ERASED) != 0;
+        page->loaded = page->erased;
+    }
+    free(entries);
+
+    nv_header_saved = true;
+    return true;
+}
+
+// Writes page table entry (and header if not yet done), plus the given range of page data
+static bool nv_save_page(uint32_t page_idx, uint32_t page_offset, uint32_t num_bytes)
+{
+    stub_page_t* page = &pages[page_idx];
+
+    if(!nv_header_saved)
+    {
+        const nv_image_header_t header = {
+            .magic = NV_IMAGE_MAGIC, .version = NV_IMAGE_VERSION, .num_pages = num_pages,
+        };
+        if(!save_state_at(0, (const uint8_t*)&header, sizeof(header)))
+        {
+            return false;
+        }
+
+        nv_image_page_t* entries = malloc((size_t)num_pages * sizeof(nv_image_page_t));
+        assert(entries != NULL);
+        for(uint32_t idx = 0; idx < num_pages; ++idx)
+        {
+            entries[idx] = pages[idx].nv;
+        }
+        bool saved = save_state_at(sizeof(header), (const uint8_t*)entries, num_pages * sizeof(nv_image_page_t));
+        free(entries);
+        if(!saved)
+        {
+            return false;
+        }
+        nv_header_saved = true;
+    }
+
+    if(page->erased)
+    {
+        page->nv.flags = NV_PAGE_ERASED;
+        page->nv.crc32 = 0;
+    }
+    else
+    {
+        // File holds nothing for a page saved as erased, write all of it
+        if(page->nv.flags & NV_PAGE_ERASED)
+        {
+            page_offset = 0;
+            num_bytes   = page->nv.size_bytes;
+        }
+
+        if(!save_state_at(page->nv.file_offset + page_offset, page->data + page_offset, num_bytes))
+        {
+            return false;
+        }
+        page->nv.flags = NV_PAGE_VALID;
+        page->nv.crc32 = crc32(page->data, page->nv.size_bytes);
+    }
+
+    return save_state_at(sizeof(nv_image_header_t) + (uint64_t)page_idx * sizeof(nv_image_page_t),
+                         (const uint8_t*)&page->nv, sizeof(nv_image_page_t));
+}
+
+// Brings page contents into memory on first access
+static bool page_load(uint32_t page_idx)
+{
+    stub_page_t* page = &pages[page_idx];
+
+    if(page->loaded)
+    {
+        return true;
+    }
+
+    if(page_alloc(page) == NULL)
+    {
+        printf("ll_flash:page_load: no memory for page %u\n", page_idx);
+        return false;
+    }
+
+    if(!load_state_at(page->nv.file_offset, page->data, page->nv.size_bytes) ||
+       (crc32(page->data, page->nv.size_bytes) != page->nv.crc32))
+    {
+        printf("ll_flash:page_load: page %u load failed or CRC mismatch\n", page_idx);
+        return false;
+    }
+
+    page->loaded = true;
+    return true;
+}
+
+// Returns page memory ready to be programmed, materialising erased pages as 0xFF
+static uint8_t* page_program_data(uint32_t page_idx)
+{
+    stub_page_t* page = &pages[page_idx];
+
+    if(!page_load(page_idx))
+    {
+        return NULL;
+    }
+
+    if(page->erased)
+    {
+        if(page_alloc(page) == NULL)
+        {
+            return NULL;
+        }
+        memset(page->data, 0xFF, page->nv.size_bytes);
+        page->erased = false;
+    }
+
+    return page->data;
+}
+
+#if defined(__SSE2__)
+// Recount of an already ANDed block, bits set in src but not in dst
+static uint64_t program_and_count(const uint8_t* dst, const uint8_t* src, uint32_t num_bytes)
+{
+    uint64_t num_bits = 0;
+    for(uint32_t idx = 0; idx < num_bytes; ++idx)
+    {
+        num_bits += (uint64_t)__builtin_popcount((uint8_t)(~dst[idx] & src[idx]));
+    }
+    return num_bits;
+}
+#endif
+
+// dst &= src (NOR program), RETURNS: number of bits src tried to take 0->1
+static uint64_t program_and(uint8_t* dst, const uint8_t* src, uint32_t num_bytes)
+{
+    uint64_t num_bits = 0;
+    uint32_t idx = 0;
+
+#if defined(__SSE2__)
+    // 64 bytes per step, violations OR'd together so the common (clean) case is one test
+    const __m128i zero = _mm_setzero_si128();
+    for(; (idx + 64) <= num_bytes; idx += 64)
+    {
+        __m128i set = zero;
+        for(uint32_t lane = 0; lane < 64; lane += 16)
+        {
+            __m128i cur = _mm_loadu_si128((const __m128i*)(dst + idx + lane));
+            __m128i val = _mm_loadu_si128((const __m128i*)(src + idx + lane));
+            set = _mm_or_si128(set, _mm_andnot_si128(cur, val));
+            _mm_storeu_si128((__m128i*)(dst + idx + lane), _mm_and_si128(cur, val));
+        }
+
+        // Rare, only pay for a popcount when something was violated
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(set, zero)) != 0xFFFF)
+        {
+            num_bits += program_and_count(dst + idx, src + idx, 64);
+        }
+    }
+#endif
+
+    for(; (idx + 8) <= num_bytes; idx += 8)
+    {
+        uint64_t cur, val;
+        memcpy(&cur, dst + idx, sizeof(cur));
+        memcpy(&val, src + idx, sizeof(val));
+        num_bits += (uint64_t)__builtin_popcountll(~cur & val);
+        cur &= val;
+        memcpy(dst + idx, &cur, sizeof(cur));
+    }
+
+    for(; idx < num_bytes; ++idx)
+    {
+        num_bits += (uint64_t)__builtin_popcount((uint8_t)(~dst[idx] & src[idx]));
+        dst[idx] &= src[idx];
+    }
+
+    return num_bits;
+}
+
+static uint32_t word_num_bytes(void)
+{
+    return 1u << ll_flash_ptr->write_granularity;
+}
+
+// Marks the words spanned by [page_offset, page_offset + num_bytes) programmed.
+// RETURNS: number of those words already programmed since their last erase
+static uint32_t page_mark_programmed(uint32_t page_idx, uint32_t page_offset, uint32_t num_bytes)
+{
+    stub_page_t* page = &pages[page_idx];
+    uint32_t word_bytes = word_num_bytes();
+    uint32_t num_words  = (page->nv.size_bytes + word_bytes - 1) / word_bytes;
+
+    if(page->programmed == NULL)
+    {
+        // Derive from contents, anything not erased was programmed. An erased page has
+        // nothing programmed, so this must run before the page is materialised as 0xFF.
+        page->programmed = calloc((num_words + 7) / 8, 1);
+        assert(page->programmed != NULL);
+        if(!page->erased && !page_load(page_idx))
+        {
+            return 0;
+        }
+        for(uint32_t word = 0; !page->erased && (word < num_words); ++word)
+        {
+            const uint8_t* data = page->data + (word * word_bytes);
+            uint32_t len = ((word * word_bytes) + word_bytes <= page->nv.size_bytes) ? word_bytes : (page->nv.size_bytes - (word * word_bytes));
+            for(uint32_t idx = 0; idx < len; ++idx)
+            {
+                if(data[idx] != 0xFF)
+                {
+                    page->programmed[word >> 3] |= (uint8_t)(1u << (word & 7));
+                    break;
+                }
+            }
+        }
+    }
+
+    uint32_t num_reprogrammed = 0;
+    uint32_t last = (page_offset + num_bytes - 1) / word_bytes;
+    for(uint32_t word = page_offset / word_bytes; word <= last; )
+    {
+        if(((word & 7) == 0) && ((last - word) >= 7))
+        {
+            num_reprogrammed += (uint32_t)__builtin_popcount(page->programmed[word >> 3]);
+            page->programmed[word >> 3] = 0xFF;
+            word += 8;
+        }
+        else
+        {
+            uint8_t bit = (uint8_t)(1u << (word & 7));
+            num_reprogrammed += (page->programmed[word >> 3] & bit) != 0;
+            page->programmed[word >> 3] |= bit;
+            ++word;
+        }
+    }
+
+    return num_reprogrammed;
+}
+
+// Any erase (full or partial) drops the programmed bitmap, it is re-derived on next use
+static void page_forget_programmed(stub_page_t* page)
+{
+    free(page->programmed);
+    page->programmed = NULL;
+}
+
+uint32_t ll_flash_stub_image_num_bytes(void)
+{
+    assert(ll_flash_ptr != NULL);
+
+    uint32_t num_bytes = 0;
+    for(uint32_t page_idx = 0; page_idx < num_pages; ++page_idx)
+    {
+        num_bytes += pages[page_idx].nv.size_bytes;
+    }
+    return num_bytes;
+}
+
+bool ll_flash_stub_image_export(uint8_t* image)
+{
+    assert(image != NULL);
+
+    for(uint32_t page_idx = 0; page_idx < num_pages; ++page_idx)
+    {
+        stub_page_t* page = &pages[page_idx];
+        if(page->erased)
+        {
+            memset(image, 0xFF, page->nv.size_bytes);
+        }
+        else if(page_load(page_idx))
+        {
+            memcpy(image, page->data, page->nv.size_bytes);
+        }
+        else
+        {
+            return false;
+        }
+        image += page->nv.size_bytes;
+    }
+    return true;
+}
+
+bool ll_flash_stub_image_import(const uint8_t* image)
+{
+    assert(image != NULL);
+
+    for(uint32_t page_idx = 0; page_idx < num_pages; ++page_idx)
+    {
+        stub_page_t* page = &pages[page_idx];
+        uint32_t size = page->nv.size_bytes;
+
+        // All 0xFF pages stay (or become) holes
+        bool erased = (image[0] == 0xFF) && (memcmp(image, image + 1, size - 1) == 0);
+        page->loaded = true;
+        page->erased = true;
+        page_forget_programmed(page);
+        if(!erased)
+        {
+            uint8_t* data = page_program_data(page_idx);
+            if(data == NULL)
+            {
+                return false;
+            }
+            memcpy(data, image, size);
+        }
+
+        if(persist && !nv_save_page(page_idx, 0, size))
+        {
+            return false;
+        }
+        image += size;
+    }
+    return true;
+}
+
+bool ll_flash_stub_page_wear(uint32_t page_idx, ll_flash_stub_page_wear_t* wear)
+{
+    assert(wear != NULL);
+
+    if(page_idx >= num_pages)
+    {
+        return false;
+    }
+    *wear = pages[page_idx].wear;
+    return true;
+}
+
+void ll_flash_stub_clear_wear(void)
+{
+    for(uint32_t page_idx = 0; page_idx < num_pages; ++page_idx)
+    {
+        memset(&pages[page_idx].wear, 0, sizeof(pages[page_idx].wear));
+    }
+}
+
+uint32_t ll_flash_stub_num_resident_pages(void)
+{
+    uint32_t num_resident = 0;
+    for(uint32_t page_idx = 0; page_idx < num_pages; ++page_idx)
+    {
+        num_resident += (pages[page_idx].data != NULL);
+    }
+    return num_resident;
+}
 
 ll_flash_status_t ll_flash_init(ll_flash_config_t* _ll_flash_ptr)
 {
     assert(_ll_flash_ptr != NULL);
+    assert(_ll_flash_ptr->pages_total_num > 0);
+    assert((_ll_flash_ptr->sectors_total_num == 0) || (_ll_flash_ptr->sector_descriptors != NULL));
     ll_flash_ptr = _ll_flash_ptr;
 
-    if(!load_state(mem, FLASH_SIZE))
+    // Pages sorted by address, sectors by first page
+    bool geometry_ok = page_table_init(&page_table, ll_flash_ptr->page_descriptors, ll_flash_ptr->pages_total_num);
+    assert(geometry_ok);
+    (void)geometry_ok;
+
+    for(uint32_t sector_idx = 0; sector_idx < ll_flash_ptr->sectors_total_num; ++sector_idx)
+    {
+        const sector_dsc_t* sector = &ll_flash_ptr->sector_descriptors[sector_idx];
+        assert(sector->num_pages > 0);
+        assert((sector->first_page_idx + sector->num_pages) <= ll_flash_ptr->pages_total_num);
+        assert((sector_idx == 0) || (sector[-1].first_page_idx <= sector->first_page_idx));
+        (void)sector;
+    }
+
+    bank_map();
+
+    if(!persist)
+    {
+        // In-memory only, image survives re-init (faux power cycle)
+        if((pages == NULL) || (num_pages != ll_flash_ptr->pages_total_num))
+        {
+            return pages_reset() ? ll_flash_status_ok : ll_flash_status_fail;
+        }
+        return ll_flash_status_ok;
+    }
+
+    if(!pages_reset())
     {
-        memset(mem, 0xFF, FLASH_SIZE); // Set flash stub to flash full erased state 
+        return ll_flash_status_fail;
+    }
+    if(!nv_load_page_table())
+    {
+        pages_reset(); // Set flash stub to flash full erased state
         printf("ll_flash:ll_flash_init: stub nv load failed, flash in erased state\n");
         return ll_flash_status_fail;
     }
@@ -28,54 +818,230 @@ ll_flash_status_t ll_flash_read(uint32_t addr, uint8_t* data, uint32_t num_bytes
     assert(num_bytes > 0);
     assert(data != NULL);
 
-    // Offset the addr to zero index for stub fake mem array indexing
-    addr -= ll_flash_ptr->page_descriptors[0].base_addr;
-    assert(addr < FLASH_SIZE);
+    while(num_bytes > 0)
+    {
+        uint32_t page_offset;
+        uint32_t page_idx = page_lookup(addr, &page_offset);
+        stub_page_t* page = &pages[page_idx];
+
+        uint32_t len = page->nv.size_bytes - page_offset;
+        len = (len < num_bytes) ? len : num_bytes;
+
+        bank_read_wait(page_idx);
+        if(page->erased)
+        {
+            memset(data, 0xFF, len);
+        }
+        else if(page_load(page_idx))
+        {
+            memcpy(data, page->data + page_offset, len);
+        }
+        else
+        {
+            return ll_flash_status_fail;
+        }
+
+        addr      += len;
+        data      += len;
+        num_bytes -= len;
+    }
 
-    memcpy(data, mem + addr, num_bytes);
     return ll_flash_status_ok;
 }
 
-ll_flash_status_t ll_flash_write(uint32_t addr, uint8_t* data, uint32_t num_bytes)
+ll_flash_status_t ll_flash_write(uint32_t addr, const uint8_t* data, uint32_t num_bytes)
+{
+    assert(data != NULL);
+
+    const ll_flash_iovec_t iov = { .data = data, .num_bytes = num_bytes };
+    return ll_flash_writev(addr, &iov, 1);
+}
+
+ll_flash_status_t ll_flash_writev(uint32_t addr, const ll_flash_iovec_t* iov, uint32_t iov_count)
 {
     assert(ll_flash_ptr != NULL);
+    assert(iov != NULL);
+
+    uint32_t num_bytes = 0;
+    for(uint32_t idx = 0; idx < iov_count; ++idx)
+    {
+        assert((iov[idx].data != NULL) || (iov[idx].num_bytes == 0));
+        num_bytes += iov[idx].num_bytes;
+    }
     assert(num_bytes > 0);
-    assert(data != NULL);
 
-    // Offset the addr to zero index for stub fake mem array indexing
-    addr -= ll_flash_ptr->page_descriptors[0].base_addr;
-    assert(addr < FLASH_SIZE);
+    // One transaction, power may be lost anywhere within it
+    uint32_t num_applied = fault_bytes_applied(ll_flash_stub_op_program, addr, num_bytes);
+
+    // Walk destination pages and source buffers together
+    uint32_t iov_idx = 0, iov_offset = 0;
+    uint64_t num_bits_set = 0;
+    uint32_t num_reprogrammed = 0;
+    while(num_applied > 0)
+    {
+        uint32_t page_offset;
+        uint32_t page_idx = page_lookup(addr, &page_offset);
+
+        uint32_t page_len = pages[page_idx].nv.size_bytes - page_offset;
+        page_len = (page_len < num_applied) ? page_len : num_applied;
+
+        if(program_mode.once_per_word)
+        {
+            num_reprogrammed += page_mark_programmed(page_idx, page_offset, page_len);
+        }
+
+        uint8_t* dst = page_program_data(page_idx);
+        if(dst == NULL)
+        {
+            return ll_flash_status_fail;
+        }
+
+        for(uint32_t copied = 0; copied < page_len; )
+        {
+            uint32_t len = iov[iov_idx].num_bytes - iov_offset;
+            len = (len < (page_len - copied)) ? len : (page_len - copied);
+            if(len > 0)
+            {
+                if(program_mode.nor)
+                {
+                    num_bits_set += program_and(dst + page_offset + copied, iov[iov_idx].data + iov_offset, len);
+                }
+                else
+                {
+                    memcpy(dst + page_offset + copied, iov[iov_idx].data + iov_offset, len);
+                }
+            }
+            copied     += len;
+            iov_offset += len;
+            if(iov_offset == iov[iov_idx].num_bytes)
+            {
+                ++iov_idx;
+                iov_offset = 0;
+            }
+        }
+
+        ++pages[page_idx].wear.program_ops;
+        pages[page_idx].wear.bytes_programmed += page_len;
+        bank_post(page_idx, (uint64_t)banks.timing.program_ticks_per_word *
+                            ((page_len + word_num_bytes() - 1) / word_num_bytes()));
 
-    memcpy(mem + addr, data, num_bytes);
-    if(!save_state(mem, FLASH_SIZE))
+        if(persist && !nv_save_page(page_idx, page_offset, page_len))
+        {
+            printf("ll_flash:ll_flash_writev: save state call failure");
+            return ll_flash_status_fail;
+        }
+
+        addr        += page_len;
+        num_applied -= page_len;
+        num_bytes   -= page_len;
+    }
+
+    program_stats.bits_set_without_erase += num_bits_set;
+    program_stats.words_reprogrammed     += num_reprogrammed;
+
+    if(num_bytes != 0)
+    {
+        return ll_flash_status_fail; // Power lost part way through
+    }
+
+    if(program_mode.strict && ((num_bits_set > 0) || (num_reprogrammed > 0)))
     {
-        printf("ll_flash:ll_flash_write: save state call failure");
+        ++program_stats.programs_failed;
         return ll_flash_status_fail;
     }
 
     return ll_flash_status_ok;
 }
 
-ll_flash_status_t ll_flash_page_erase(uint8_t page_idx)
+ll_flash_status_t ll_flash_page_erase(uint32_t page_idx)
 {
-    assert(ll_flash_ptr != NULL);
-    assert(page_idx < ll_flash_ptr->pages_total_num);
+    return ll_flash_range_erase(page_idx, 1);
+}
 
-    // Offset the addr to zero index for stub fake mem array indexing
-    uint32_t addr = ll_flash_ptr->page_descriptors[page_idx].base_addr;
-    addr -= ll_flash_ptr->page_descriptors[0].base_addr;
-    assert(addr < FLASH_SIZE);
+// A single page, or a range matching one sector descriptor exactly
+static bool range_is_erasable(uint32_t first_page_idx, uint32_t page_count)
+{
+    if(page_count == 1)
+    {
+        return true;
+    }
 
-    for(;addr < ll_flash_ptr->page_descriptors[page_idx].size_bytes; ++addr)
+    for(uint32_t sector_idx = page_table_sector_lower_bound(ll_flash_ptr->sector_descriptors,
+                                                            ll_flash_ptr->sectors_total_num, first_page_idx);
+        (sector_idx < ll_flash_ptr->sectors_total_num) &&
+        (ll_flash_ptr->sector_descriptors[sector_idx].first_page_idx == first_page_idx);
+        ++sector_idx)
     {
-        mem[addr] = 0xFF;
+        if(ll_flash_ptr->sector_descriptors[sector_idx].num_pages == page_count)
+        {
+            return true;
+        }
     }
+    return false;
+}
+
+ll_flash_status_t ll_flash_range_erase(uint32_t first_page_idx, uint32_t page_count)
+{
+    assert(ll_flash_ptr != NULL);
+    assert(page_count > 0);
+    assert((first_page_idx + page_count) <= ll_flash_ptr->pages_total_num);
 
-    if(!save_state(mem, FLASH_SIZE))
+    if(!range_is_erasable(first_page_idx, page_count))
     {
-        printf("ll_flash:ll_flash_page_erase: save state call failure");
+        assert(0); // Not an erase the part can do in one go
         return ll_flash_status_fail;
     }
 
+    uint32_t num_bytes = 0;
+    for(uint32_t page_idx = first_page_idx; page_idx < (first_page_idx + page_count); ++page_idx)
+    {
+        num_bytes += pages[page_idx].nv.size_bytes;
+    }
+
+    // One op, power lost part way erases the leading bytes of the range only
+    uint32_t num_applied = fault_bytes_applied(ll_flash_stub_op_erase, pages[first_page_idx].nv.base_addr, num_bytes);
+    uint32_t num_left = num_applied;
+
+    for(uint32_t page_idx = first_page_idx; page_idx < (first_page_idx + page_count); ++page_idx)
+    {
+        stub_page_t* page = &pages[page_idx];
+        uint32_t page_applied = (num_left < page->nv.size_bytes) ? num_left : page->nv.size_bytes;
+        num_left -= page_applied;
+
+        if(page_applied > 0)
+        {
+            page_forget_programmed(page); // Fully erased pages re-derive as all unprogrammed
+            ++page->wear.erase_count;
+            bank_post(page_idx, banks.timing.erase_ticks_per_page);
+        }
+
+        if(page_applied == page->nv.size_bytes)
+        {
+            page->erased = true;
+            page->loaded = true;
+        }
+        else if(!page->erased && (page_applied > 0))
+        {
+            // Partial erase, leading bytes only
+            uint8_t* data = page_program_data(page_idx);
+            if(data == NULL)
+            {
+                return ll_flash_status_fail;
+            }
+            memset(data, 0xFF, page_applied);
+        }
+
+        if(persist && !nv_save_page(page_idx, 0, page->nv.size_bytes))
+        {
+            printf("ll_flash:ll_flash_range_erase: save state call failure");
+            return ll_flash_status_fail;
+        }
+    }
+
+    if(num_applied != num_bytes)
+    {
+        return ll_flash_status_fail; // Power lost part way through
+    }
+
     return ll_flash_status_ok;
-}
\ No newline at end of file
+}
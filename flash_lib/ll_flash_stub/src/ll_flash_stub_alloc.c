@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "ll_flash_stub.h"
+
+/*
+    Page memory allocators for the ll flash stub, see ll_flash_stub.h.
+*/
+
+// Transparent hugepages are 2MiB on x86-64 and arm64, the mapping is aligned to that
+#define STUB_HUGE_PAGE_BYTES (2UL * 1024UL * 1024UL)
+
+static bool heap_reserve(void* ctx, size_t device_num_bytes)
+{
+    (void)ctx;
+    (void)device_num_bytes;
+    return true;
+}
+
+static void* heap_alloc(void* ctx, size_t device_offset, size_t num_bytes)
+{
+    (void)ctx;
+    (void)device_offset;
+    return malloc(num_bytes);
+}
+
+static void heap_release(void* ctx, void* data, size_t device_offset, size_t num_bytes)
+{
+    (void)ctx;
+    (void)device_offset;
+    (void)num_bytes;
+    free(data);
+}
+
+ll_flash_stub_allocator_t ll_flash_stub_heap_allocator(void)
+{
+    return (ll_flash_stub_allocator_t){ .reserve = heap_reserve, .alloc = heap_alloc, .release = heap_release };
+}
+
+static bool arena_reserve(void* ctx, size_t device_num_bytes)
+{
+    const ll_flash_stub_arena_t* arena = (const ll_flash_stub_arena_t*)ctx;
+    return device_num_bytes <= arena->num_bytes;
+}
+
+static void* arena_alloc(void* ctx, size_t device_offset, size_t num_bytes)
+{
+    const ll_flash_stub_arena_t* arena = (const ll_flash_stub_arena_t*)ctx;
+    if((device_offset + num_bytes) > arena->num_bytes)
+    {
+        return NULL;
+    }
+    return arena->base + device_offset;
+}
+
+static void region_release(void* ctx, void* data, size_t device_offset, size_t num_bytes)
+{
+    // Pages live in the region until it is reserved again
+    (void)ctx;
+    (void)data;
+    (void)device_offset;
+    (void)num_bytes;
+}
+
+ll_flash_stub_allocator_t ll_flash_stub_arena_allocator(ll_flash_stub_arena_t* arena)
+{
+    return (ll_flash_stub_allocator_t){
+        .reserve = arena_reserve, .alloc = arena_alloc, .release = region_release, .ctx = arena,
+    };
+}
+
+// One mapping at a time, a reserve replaces the previous one
+static struct {
+    uint8_t* map;       // as returned by mmap
+    size_t map_num_bytes;
+    uint8_t* base;      // hugepage aligned start within map
+    size_t num_bytes;
+} region;
+
+// mmap allocator ctx, whether its mappings are hugepage backed. Each allocator carries its
+// own, so making another allocator never changes how one already set maps its next device.
+static bool mmap_small_pages = false;
+static bool mmap_huge_pages  = true;
+
+static void mmap_unmap(void)
+{
+    if(region.map != NULL)
+    {
+        munmap(region.map, region.map_num_bytes);
+    }
+    region.map       = NULL;
+    region.base      = NULL;
+    region.num_bytes = 0;
+}
+
+static bool mmap_reserve(void* ctx, size_t device_num_bytes)
+{
+    bool huge_pages = *(const bool*)ctx;
+    mmap_unmap();
+    if(device_num_bytes == 0)
+    {
+        return true;
+    }
+
+    // Reserve address space only, the OS commits memory for the pages touched
+    size_t align = huge_pages ? STUB_HUGE_PAGE_BYTES : 0;
+    size_t map_num_bytes = device_num_bytes + align;
+    void* map = mmap(NULL, map_num_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(map == MAP_FAILED)
+    {
+        return false;
+    }
+
+    region.map           = (uint8_t*)map;
+    region.map_num_bytes = map_num_bytes;
+    region.base          = region.map;
+    region.num_bytes     = device_num_bytes;
+
+    if(huge_pages)
+    {
+        uintptr_t aligned = ((uintptr_t)map + align - 1) & ~(uintptr_t)(align - 1);
+        region.base = (uint8_t*)aligned;
+#ifdef MADV_HUGEPAGE
+        madvise(region.base, device_num_bytes, MADV_HUGEPAGE);
+#endif
+    }
+    return true;
+}
+
+static void* mmap_alloc(void* ctx, size_t device_offset, size_t num_bytes)
+{
+    (void)ctx;
+    if((region.base == NULL) || ((device_offset + num_bytes) > region.num_bytes))
+    {
+        return NULL;
+    }
+    return region.base + device_offset;
+}
+
+ll_flash_stub_allocator_t ll_flash_stub_mmap_allocator(bool huge_pages)
+{
+    return (ll_flash_stub_allocator_t){
+        .reserve = mmap_reserve, .alloc = mmap_alloc, .release = region_release,
+        .ctx = huge_pages ? &mmap_huge_pages : &mmap_small_pages,
+    };
+}
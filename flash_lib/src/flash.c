@@ -1,166 +1,384 @@
 #include <assert.h>
-#include "crc.h"
+#include <stddef.h>
+#include <string.h>
 #include "flash.h"
 #include "flash_conf.h"
+#include "page_table.h"
+#include "ll_flash_trace.h"
 
 /* Upper-level flash module, manages app_data layout within flash.
    A configurable number of app_data copies, where each app_data copy spans a number of whole pages.
-   The active copy is determined by a validity pattern at at its base page addr.
-   On write we write to the next app_data copy region in ascending sequence, provides wear-levelling mechanism and also allows ability to roll-back app_data (not yet implemented)
+   Copies are versioned, each commit stamps its copy with the next sequence number and the
+   active copy is the committed copy (validity pattern at its base page addr) with the latest
+   activation whose integrity check passes. Older copies are retained until overwritten, which provides
+   wear-levelling and the version history used for reads of older versions and roll-back.
 
    Each app_data copy is prepended with an app_mete_data_t, which contains:
-   4BYTE_VALIDATION, 4BYTE_APP_LEN, 4BYTE_CRC
+   4BYTE_VALIDATION, FLASH_META_NUM_ACTIVATIONS x 8BYTE_ACTIVATION, 4BYTE_APP_LEN, 4BYTE_SEQUENCE,
+   4BYTE_INTEGRITY_ID, 8BYTE_CHECK
+   Validity and each activation slot sit in their own FLASH_META_PROGRAM_UNIT and are left
+   erased by the commit, so no flash word is ever programmed twice between erases (NOR / ECC
+   parts). The integrity algorithm (CRC32 by default, see flash_integrity.h) is chosen per
+   flash_config_t and its id recorded per copy, so switching algorithm keeps older copies
+   readable and each copy is checked with the algorithm that wrote it. A roll-back programs one slot of the target copy with a fresh sequence number
+   (and its inverse) so it outranks every other copy.
 
    A pointer to the app_data itself and its total size in bytes are assigned via flash_config_t.
    Hence app data can be modified freely at runtime, then a single call to flash_write handles storage..
+   Alternatively app_data can be described as a list of segments (pointer, length), these are
+   streamed back to back into a single copy (one integrity check, one validity flip) and scattered back
+   into place on load, so separate buffers need not be staged into one array first.
 
    PUBLIC FUNCTIONS
 
    flash_init:
        Takes a flash_config_t pointer (grabs local ptr copy).
        Determines if requested layout is valid.
-       Computes the base address of each app_data copy, stores in array
-       Identifies active copy via 4BYTE validity pattern in app meta.
-       Evaluates CRC32 of the currently active copy of flash.
-       TODO: Roll back through app data copies if corruption detected.
+       Computes the base address of each app_data copy (or takes a precomputed copy_layout), stores in array.
+       Copies never span a bank and are spread round-robin over the configured banks of the part.
+       Reads the meta data of every copy, committed copies are ranked by activation.
+       Loads the latest activated copy whose integrity check passes, falling back to older
+       versions if corruption is detected.
+       With no committed copy at all, looks for a copy written before versioning (validity,
+       length, CRC32 header at a page base, read at each page base) and commits it as version 1.
+
+   flash_deinit:
+       Drops the module state so flash_init can be called again (host test harnesses only).
 
    flash_write:
-       Computes a new app_meta_t CRC32, assigns app_data len + validity (NOT VALID PATTERN, 0xFFFFFFFF)
-       Grabs the base addr of the next unused app_data copy region from array
-       Determines number of pages required to store app_data.
-       Erases the next unused app_data copy region in sequence
-       Writes the meta_data_t section to the base addr
-       Writes app_data immediately after meta data.
-       Reads back and evaluates CRC32 of app_data.
-       Invalidates the most recent app_data active copy (writes 0 to validity)
-       Validates the new app_data active copy (writes VALID PATTERN 0x55555555) 
+       Computes the app_data integrity value with the configured algorithm, assigns app_data len, next sequence number and
+       validity (NOT VALID PATTERN, 0xFFFFFFFF)
+       Picks the least recently activated copy region which is not the active copy, preferring
+       copies outside the active copy's bank (read-while-write parts keep serving reads of the
+       active version while the other bank erases / programs).
+       Erases that region with the fewest ops: at each page the largest described sector
+       starting there which fits within the region, else the single page, so a region
+       aligned to a sector is a single ll_flash_range_erase.
+       Writes the meta_data_t section from length onwards, app_data immediately after it,
+       as one vectored ll_flash_writev straight from the app buffers (no staging copy).
+       Reads back and re-checks the integrity of app_data.
+       Validates the new app_data copy (writes VALID PATTERN 0x55555555) and reads it back, so
+       the commit returns with its bank idle. Its sequence now outranks the previous active
+       copy which is retained as history, not invalidated.
+       Power loss at any point leaves either the previous or the new copy active.
+
+   flash_read:
+       Reloads the active copy into the app_data buffers.
+
+   flash_versions:
+       Lists retained versions newest first (copy index, version, activation, length, integrity status).
+
+   flash_read_version:
+       Streams a range of any retained version into a caller buffer, app_data and the
+       active copy are untouched.
+
+   flash_rollback:
+       Re-activates a retained version by programming one activation slot in its meta data
+       (8 bytes, no erase, no data rewrite), then loads it into the app_data buffers.
+
+   flash_scrub_step:
+       Checks the integrity of the inactive retained copies a bounded number of bytes per call,
+       the partial integrity state carries over between calls. Walks the copies in index order,
+       skipping empty copies and the active one (verified when loaded, committed or rolled back),
+       and restarts a copy's check when a commit or rollback changes it part way through.
+       flash_init only verifies the copy it loads, so boot time does not grow with the history.
+
+   flash_version_health:
+       Result of the latest check of a retained version (unchecked / ok / corrupt).
+
+   flash_scrub_stats:
+       Passes, copies checked, failures and bytes read by the scrubber since flash_init.
 */
 
+// Validity pattern programmed in place, written straight from flash constant
+static const uint32_t app_data_valid = CFG_APP_DATA_VALID;
+
+// Max buffers handed to a single ll_flash_writev (meta data + segments)
+#define FLASH_WRITEV_MAX_IOV 8
+
+// Stack buffer used to stream integrity checks of copies which are not loaded into app_data
+#define FLASH_CRC_CHUNK_BYTES 256
+
+// Commit write starts here, validity and activation slots before it stay erased
+#define FLASH_META_COMMIT_OFFSET offsetof(app_data_meta_t, length)
+
+// Erased flash, an unprogrammed sequence or activation slot reads as this
+#define FLASH_SEQUENCE_ERASED 0xFFFFFFFF
+
+// Header written by firmware before copies were versioned, the app_data (checked by CRC32)
+// follows it directly. Its length sits in the word app_data_meta_t leaves erased as padding.
+typedef struct
+{
+    uint32_t validity;
+    uint32_t length;
+    uint32_t crc32;
+} app_data_meta_v0_t;
+
 // Privates
 static struct {
     flash_config_t* conf_ptr;
     bool has_valid_data;
     bool initialized;
 
-    uint32_t total_flash_bytes;
-    uint8_t  app_data_active_copy_base_page_idx;
-    uint32_t data_copies_base_addrs[CFG_APP_DATA_NUM_COPIES];
+    // Copy count is set at runtime, per copy state is sized for the most we support
+    uint32_t num_copies;
+    uint32_t app_data_active_copy_idx;
+    uint32_t data_copies_base_addrs[CFG_APP_DATA_MAX_COPIES];
+    uint32_t data_copies_base_page_idx[CFG_APP_DATA_MAX_COPIES];
+    uint32_t data_copies_num_pages[CFG_APP_DATA_MAX_COPIES];
+    uint32_t data_copies_bank[CFG_APP_DATA_MAX_COPIES];
+
+    // Per copy commit sequence and latest activation, both 0 when the copy holds no committed data
+    uint32_t data_copies_version[CFG_APP_DATA_MAX_COPIES];
+    uint32_t data_copies_activation[CFG_APP_DATA_MAX_COPIES];
+    uint32_t next_sequence;
+
+    // Algorithm for new commits
+    const flash_integrity_t* integrity;
+
+    // Per copy result of the last integrity check, meaningful while the copy holds a version
+    flash_health_t data_copies_health[CFG_APP_DATA_MAX_COPIES];
+
+    // Incremental check of the inactive copies, see flash_scrub_step
+    struct {
+        uint32_t copy_idx;       // copy part way through its check, num_copies when between copies
+        uint32_t next_copy_idx;  // where the walk picks the next copy
+        uint32_t version;        // version of copy_idx when its check began, a commit over it restarts
+        uint32_t offset;         // app data bytes of copy_idx checked so far
+        uint32_t length;
+        uint64_t check;
+        const flash_integrity_t* integrity;
+        flash_integrity_state_t integrity_state;
+        flash_scrub_stats_t stats;
+    } scrub;
+
+    // app_data as segments, single_segment used when configured with a plain app_data buffer
+    const flash_data_seg_t* segments;
+    uint32_t num_segments;
+    flash_data_seg_t single_segment;
 
 } flash;
 
+static uint32_t flash_app_data_bytes_inc_meta(void);
+
+static bool flash_load_app_data_and_check_crc(uint32_t copy_idx, app_data_meta_t * app_data_meta);
+static bool flash_read_copy_meta_data(uint32_t copy_idx, app_data_meta_t* app_meta_data);
+static bool flash_copy_crc(uint32_t copy_idx, const app_data_meta_t* app_data_meta, bool* crc_ok);
+static uint32_t flash_meta_activation(const app_data_meta_t* app_meta_data);
+static void flash_scan_copies(void);
+static bool flash_erase_copy(uint32_t copy_idx);
+static int32_t flash_find_version(uint32_t version);
+static ll_flash_status_t flash_write_copy(uint32_t addr, const app_data_meta_t* app_meta_data);
+static flash_status_t flash_commit_copy(uint32_t copy_idx);
+static bool flash_load_v0_copy(uint32_t page_idx, uint32_t* num_pages);
+static flash_status_t flash_migrate_v0(void);
+static const flash_integrity_t* flash_integrity_lookup(uint32_t id);
+static bool flash_place_copy(uint32_t bank, uint32_t* page_dsc_idx, uint32_t* base_page_idx);
+static bool flash_copy_span_valid(uint32_t copy_num);
+static bool flash_copies_balanced(void);
+static bool flash_scrub_begin_copy(uint32_t copy_idx, bool* corrupt);
+static void flash_scrub_record(bool corrupt);
+static void flash_scrub_advance(void);
+
 
 flash_status_t flash_init(flash_config_t* flash_config_ptr)
 {
 
     assert(flash_config_ptr != NULL);
     assert(flash_config_ptr->ll.page_descriptors != NULL);
-    assert(flash_config_ptr->num_app_data_copies == CFG_APP_DATA_NUM_COPIES);
-    assert(flash_config_ptr->data_descriptor.app_data != NULL);
-    assert(flash_config_ptr->data_descriptor.data_num_bytes > 0);
+    assert((flash_config_ptr->data_descriptor.app_data != NULL) ||
+           (flash_config_ptr->data_descriptor.num_segments > 0));
     assert(flash_config_ptr->ll.pages_total_num > 0);                       
+    assert((flash_config_ptr->ll.sectors_total_num == 0) || (flash_config_ptr->ll.sector_descriptors != NULL));
 
-    // Each page must have a non‑zero size 
-    for (uint8_t i = 0; i < flash_config_ptr->ll.pages_total_num; ++i)
+    // A commit never erases the active copy, so power loss mid commit always leaves a good
+    // one. That takes a second copy, a single copy would have to be erased in place.
+    if ((flash_config_ptr->num_app_data_copies < 2) ||
+        (flash_config_ptr->num_app_data_copies > CFG_APP_DATA_MAX_COPIES) ||
+        (flash_config_ptr->num_banks > FLASH_MAX_BANKS))
     {
-        assert(flash_config_ptr->ll.page_descriptors[i].size_bytes > 0);     
+        return flash_status_invalid_config;
     }
 
     if (!flash.initialized)
     {
+        // Only counts as initialized once the layout is accepted, a refused configuration
+        // leaves every other call returning uninitialized
         flash.conf_ptr = flash_config_ptr;
-        flash.initialized = true;
 
-        // Compute total flash we have available in bytes 
-        flash.total_flash_bytes = 0;
-        for (uint8_t idx = 0; idx < flash.conf_ptr->ll.pages_total_num; ++idx)
+        // Resolve app_data into segments, the total length covers all of them
+        flash_data_dsc_t* dsc = &flash.conf_ptr->data_descriptor;
+        if (dsc->num_segments > 0)
         {
-            assert(flash.conf_ptr->ll.page_descriptors != NULL);
-            flash.total_flash_bytes += flash.conf_ptr->ll.page_descriptors[idx].size_bytes;
+            assert(dsc->segments != NULL);
+            dsc->data_num_bytes = 0;
+            for (uint32_t seg_idx = 0; seg_idx < dsc->num_segments; ++seg_idx)
+            {
+                assert((dsc->segments[seg_idx].data != NULL) || (dsc->segments[seg_idx].num_bytes == 0));
+                dsc->data_num_bytes += dsc->segments[seg_idx].num_bytes;
+            }
+            flash.segments     = dsc->segments;
+            flash.num_segments = dsc->num_segments;
         }
-        assert(flash.total_flash_bytes > 0);                                
+        else
+        {
+            flash.single_segment = (flash_data_seg_t){ .data = dsc->app_data, .num_bytes = dsc->data_num_bytes };
+            flash.segments       = &flash.single_segment;
+            flash.num_segments   = 1;
+        }
+        assert(dsc->data_num_bytes > 0);
+
+        flash.num_copies = flash.conf_ptr->num_app_data_copies;
 
-        // Ensure requested copies fit in the physical flash 
-        uint32_t total_required = flash_app_data_bytes_inc_meta() * flash.conf_ptr->num_app_data_copies;
-        assert(total_required > 0);                                          
+        flash.integrity = (flash.conf_ptr->integrity != NULL) ? flash.conf_ptr->integrity : &flash_integrity_crc32;
+        assert((flash.integrity->id != 0) && (flash.integrity->id != FLASH_SEQUENCE_ERASED));
+        assert((flash.conf_ptr->num_integrity_algs == 0) || (flash.conf_ptr->integrity_algs != NULL));
 
-        if (total_required > flash.total_flash_bytes)
+        // Compute and store the base page of each copy of the app data.
+        // Each copy spans whole pages and copies never share a page, else
+        // erasing one copy would destroy the tail of its neighbour. Only the
+        // pages the copies occupy are visited, running out of pages means the
+        // requested copies don't fit in the physical flash.
+        // A precomputed layout skips the walk, but may have been built for other pages
+        // or app data, so each span is checked against them before it is used.
+        for (uint32_t copy_num = 0; (flash.conf_ptr->copy_layout != NULL) && (copy_num < flash.num_copies); ++copy_num)
         {
-            return flash_status_total_size_exceeded;
+            const flash_copy_span_t* span = &flash.conf_ptr->copy_layout[copy_num];
+            if (!flash_copy_span_valid(copy_num))
+            {
+                return flash_status_invalid_config;
+            }
+
+            flash.data_copies_base_page_idx[copy_num] = span->base_page_idx;
+            flash.data_copies_num_pages[copy_num]     = span->num_pages;
+            flash.data_copies_base_addrs[copy_num]    =
+                flash.conf_ptr->ll.page_descriptors[span->base_page_idx].base_addr;
+            flash.data_copies_bank[copy_num]          =
+                flash.conf_ptr->ll.page_descriptors[span->base_page_idx].bank;
         }
 
-        //Compute and store the base address of each copy of the app data
-        for (uint32_t copy_num = 0, bytes_traversed = 0, page_dsc_idx = 0;
-             copy_num < CFG_APP_DATA_NUM_COPIES; ++copy_num)
+        // Copies are dealt round-robin over the configured banks (in order of first appearance),
+        // so on a read-while-write part neighbouring copies, and with them the active copy and
+        // the next commit target, sit in different banks. Pages are looked at only up to the
+        // first page of the last bank, each bank's copies are placed from there on. One bank
+        // places copies in page order within the bank of the first page.
+        uint32_t num_banks = (flash.conf_ptr->num_banks > 1) ? flash.conf_ptr->num_banks : 1;
+        uint32_t banks[FLASH_MAX_BANKS]         = { flash.conf_ptr->ll.page_descriptors[0].bank };
+        uint32_t bank_page_idx[FLASH_MAX_BANKS] = { 0 };
+        uint32_t num_banks_found = 1;
+        for (uint32_t page_dsc_idx = 1;
+             (flash.conf_ptr->copy_layout == NULL) && (num_banks_found < num_banks) &&
+             (page_dsc_idx < flash.conf_ptr->ll.pages_total_num); ++page_dsc_idx)
         {
-            assert(page_dsc_idx < flash.conf_ptr->ll.pages_total_num);       
-
-            if (copy_num == 0)
+            uint32_t bank_num = 0;
+            while ((bank_num < num_banks_found) && (banks[bank_num] != flash.conf_ptr->ll.page_descriptors[page_dsc_idx].bank))
             {
-                bytes_traversed = 0;
-                flash.data_copies_base_addrs[copy_num] =
-                    flash.conf_ptr->ll.page_descriptors[page_dsc_idx].base_addr;
-                continue;
+                ++bank_num;
             }
-            else
+            if (bank_num == num_banks_found)
             {
-                do
-                {
-                    assert(page_dsc_idx < flash.conf_ptr->ll.pages_total_num);
-                    assert(copy_num < CFG_APP_DATA_NUM_COPIES);
-
-                    if ((flash.conf_ptr->ll.page_descriptors[page_dsc_idx].size_bytes + bytes_traversed) >=
-                        flash.conf_ptr->data_descriptor.data_num_bytes)
-                    {
-                    
-                        assert(page_dsc_idx < flash.conf_ptr->ll.pages_total_num); 
-
-                        flash.data_copies_base_addrs[copy_num] =
-                            flash.conf_ptr->ll.page_descriptors[page_dsc_idx].base_addr;
-                        bytes_traversed = 0;
-                        break;
-                    }
-                    else
-                    {
-                        bytes_traversed += flash.conf_ptr->ll.page_descriptors[page_dsc_idx].size_bytes;
-                    }
-                }
-                while (++page_dsc_idx < flash.conf_ptr->ll.pages_total_num);
+                bank_page_idx[num_banks_found] = page_dsc_idx;
+                banks[num_banks_found++]       = flash.conf_ptr->ll.page_descriptors[page_dsc_idx].bank;
+            }
+        }
+
+        if ((flash.conf_ptr->copy_layout == NULL) && (num_banks_found < num_banks))
+        {
+            return flash_status_invalid_config; // The pages have fewer banks than configured
+        }
+
+        for (uint32_t copy_num = 0;
+             (flash.conf_ptr->copy_layout == NULL) && (copy_num < flash.num_copies); ++copy_num)
+        {
+            uint32_t bank_num = copy_num % num_banks;
+            uint32_t base_page_idx;
+
+            if (!flash_place_copy(banks[bank_num], &bank_page_idx[bank_num], &base_page_idx))
+            {
+                return flash_status_total_size_exceeded;
             }
+
+            flash.data_copies_base_page_idx[copy_num] = base_page_idx;
+            flash.data_copies_num_pages[copy_num]     = bank_page_idx[bank_num] - base_page_idx;
+            flash.data_copies_base_addrs[copy_num]    =
+                flash.conf_ptr->ll.page_descriptors[base_page_idx].base_addr;
+            flash.data_copies_bank[copy_num]          = banks[bank_num];
+        }
+
+        // Commits go to the other bank first, so a bank holding fewer copies than another
+        // is erased more often per copy and keeps less history. Shares must be equal.
+        if (!flash_copies_balanced())
+        {
+            return flash_status_invalid_config;
         }
 
+        flash.initialized = true;
+
+        // Sequence numbers start at 1 on a blank device, flash_scan_copies moves on from the latest 
+        flash.next_sequence = 1;
+
         // Initialise LL driver 
-        ll_flash_status_t ll_status = ll_flash_init(&flash.conf_ptr->ll);
+        ll_flash_status_t ll_status = ll_trace_init(&flash.conf_ptr->ll);
         if (ll_status != ll_flash_status_ok)
         {
             return flash_status_ll_init_fault;
         }
 
-        // Search for the current valid copy of app data 
-        for (uint8_t idx = 0; idx < CFG_APP_DATA_NUM_COPIES; ++idx)
+        // Rank committed copies, then try them newest first. Anything older than
+        // a corrupted copy is a roll-back, flash_versions reports the failed check.
+        // Only the copy loaded is verified here, the scrubber gets to the rest later.
+        flash_scan_copies();
+
+        memset(&flash.scrub, 0, sizeof(flash.scrub));
+        flash.scrub.copy_idx = flash.num_copies;
+        for (uint32_t idx = 0; idx < flash.num_copies; ++idx)
         {
-            app_data_meta_t app_meta_data = {
-                .crc32    = 0,
-                .length   = 0,
-                .validity = CFG_APP_DATA_INVALID
-            };
+            flash.data_copies_health[idx] = flash_health_unchecked;
+        }
 
-            flash_read_copy_meta_data(idx, &app_meta_data);
-            if (app_meta_data.validity == CFG_APP_DATA_VALID)
+        bool any_committed = false;
+        uint32_t tried_below = FLASH_SEQUENCE_ERASED;
+        for (;;)
+        {
+            int32_t newest = -1;
+            for (uint32_t idx = 0; idx < flash.num_copies; ++idx)
             {
-                if (flash_load_app_data_and_check_crc(idx, &app_meta_data))
-                {
-                    flash.conf_ptr->data_descriptor._app_data_meta = app_meta_data;
-                    flash.app_data_active_copy_base_page_idx       = idx;
-                    flash.has_valid_data                           = true;
-                    return flash_status_ok;
-                }
-                else
+                uint32_t activation = flash.data_copies_activation[idx];
+                if ((activation != 0) && (activation < tried_below) &&
+                    ((newest < 0) || (activation > flash.data_copies_activation[newest])))
                 {
-                    // Where we might try to roll‑back app data 
-                    return flash_status_data_corruption_detected;
+                    newest = (int32_t)idx;
                 }
             }
+
+            if (newest < 0)
+            {
+                break;
+            }
+            any_committed = true;
+
+            app_data_meta_t app_meta_data;
+            if (flash_load_app_data_and_check_crc((uint32_t)newest, &app_meta_data))
+            {
+                flash.conf_ptr->data_descriptor._app_data_meta = app_meta_data;
+                flash.app_data_active_copy_idx                 = (uint32_t)newest;
+                flash.has_valid_data                           = true;
+                flash.data_copies_health[newest]               = flash_health_ok;
+                return flash_status_ok;
+            }
+
+            flash.data_copies_health[newest] = flash_health_corrupt;
+            tried_below = flash.data_copies_activation[newest];
         }
+
+        if (any_committed)
+        {
+            // Every retained version failed its integrity check 
+            return flash_status_data_corruption_detected;
+        }
+
+        // Nothing committed in this format, carry over a copy written before versioning
+        return flash_migrate_v0();
     }
     else
     {
@@ -172,16 +390,30 @@ flash_status_t flash_init(flash_config_t* flash_config_ptr)
 }
 
 
-flash_status_t flash_write(void)
+void flash_deinit(void)
 {
-    flash_status_t status = flash_status_ok;
+    // Forget everything, flash contents are left untouched
+    flash.conf_ptr                           = NULL;
+    flash.has_valid_data                     = false;
+    flash.initialized                        = false;
+    flash.num_copies                         = 0;
+    flash.app_data_active_copy_idx           = 0;
+    flash.next_sequence                      = 0;
+    flash.integrity                          = NULL;
+    flash.segments                           = NULL;
+    flash.num_segments                       = 0;
+    memset(&flash.scrub, 0, sizeof(flash.scrub));
+}
+
 
+flash_status_t flash_write(void)
+{
     //--------- Sanity checks before we touch flash ---------
     assert(flash.initialized);                                               
     assert(flash.conf_ptr != NULL);
-    assert(flash.conf_ptr->data_descriptor.app_data != NULL);
+    assert(flash.segments != NULL);
     assert(flash.conf_ptr->data_descriptor.data_num_bytes > 0);
-    assert(flash.conf_ptr->num_app_data_copies == CFG_APP_DATA_NUM_COPIES);  
+    assert((flash.num_copies >= 2) && (flash.num_copies <= CFG_APP_DATA_MAX_COPIES));
 
     if (!flash.initialized)
     {
@@ -189,90 +421,454 @@ flash_status_t flash_write(void)
         return flash_status_uninitialized;
     }
 
-    uint32_t num_bytes_to_be_erased;
-    uint32_t new_copy_base_page_idx;
-    app_data_meta_t new_app_meta_data = { .crc32 = 0, .length = 0, .validity = 0 };
+    // Overwrite the least recently activated copy, never the active one (flash_init
+    // ensures there are at least 2). Copies outside the active copy's bank go first, so the
+    // erase and program never stall reads of the active version on a read-while-write part.
+    // Ties (uncommitted copies) go in ring order after the active copy.
+    uint32_t new_copy_idx = flash.num_copies;
+    bool new_copy_other_bank = false;
+    for (uint32_t step = 1; step <= flash.num_copies; ++step)
+    {
+        uint32_t idx = (flash.app_data_active_copy_idx + step) % flash.num_copies;
+        bool other_bank = flash.data_copies_bank[idx] != flash.data_copies_bank[flash.app_data_active_copy_idx];
+
+        if (flash.has_valid_data && (idx == flash.app_data_active_copy_idx))
+        {
+            continue;
+        }
+        if ((new_copy_idx == flash.num_copies) ||
+            (other_bank && !new_copy_other_bank) ||
+            ((other_bank == new_copy_other_bank) &&
+             (flash.data_copies_activation[idx] < flash.data_copies_activation[new_copy_idx])))
+        {
+            new_copy_idx        = idx;
+            new_copy_other_bank = other_bank;
+        }
+    }
+
+    // Consistency between copy index and physical pages 
+    assert(new_copy_idx < flash.num_copies);    
 
-    // Compute base page idx of the next app_data copy region to be used 
-    if ((flash.app_data_active_copy_base_page_idx + 1) < flash.conf_ptr->num_app_data_copies)
+    return flash_commit_copy(new_copy_idx);
+}
+
+
+flash_status_t flash_read(void)
+{
+    assert(flash.initialized);
+
+    if (!flash.initialized)
     {
-        new_copy_base_page_idx = flash.app_data_active_copy_base_page_idx + 1;
+        return flash_status_uninitialized;
     }
-    else
+
+    if (!flash.has_valid_data)
     {
-        new_copy_base_page_idx = 0;
+        return flash_status_no_valid_data_found;
     }
 
-    // Consistency between copy index and physical pages 
-    assert(new_copy_base_page_idx < flash.conf_ptr->num_app_data_copies);    
+    app_data_meta_t app_meta_data;
+    if (!flash_load_app_data_and_check_crc(flash.app_data_active_copy_idx, &app_meta_data))
+    {
+        return flash_status_crc_check_failure;
+    }
+
+    flash.conf_ptr->data_descriptor._app_data_meta = app_meta_data;
+    return flash_status_ok;
+}
 
-    // Erase pages spanned by next app_data copy region 
-    num_bytes_to_be_erased = flash.conf_ptr->data_descriptor.data_num_bytes + sizeof(app_data_meta_t);
 
-    for (uint32_t page_idx = new_copy_base_page_idx;
-         page_idx < flash.conf_ptr->ll.pages_total_num;
-         ++page_idx)
+flash_status_t flash_versions(flash_version_info_t* info, uint32_t max_info, uint32_t* num_info)
+{
+    assert(flash.initialized);
+    assert((info != NULL) || (max_info == 0));
+    assert(num_info != NULL);
+
+    *num_info = 0;
+    if (!flash.initialized)
     {
-        assert(page_idx < flash.conf_ptr->ll.pages_total_num);
+        return flash_status_uninitialized;
+    }
 
-        if (ll_flash_page_erase(page_idx) != ll_flash_status_ok)
+    for (uint32_t idx = 0; idx < flash.num_copies; ++idx)
+    {
+        if (flash.data_copies_version[idx] == 0)
         {
-            return flash_status_ll_erase_fault;
+            continue;
         }
 
-        if (num_bytes_to_be_erased <= flash.conf_ptr->ll.page_descriptors[page_idx].size_bytes)
+        app_data_meta_t app_meta_data;
+        flash_version_info_t entry = {
+            .copy_idx   = idx,
+            .version    = flash.data_copies_version[idx],
+            .activation = flash.data_copies_activation[idx],
+            .bank       = flash.data_copies_bank[idx],
+            .active     = flash.has_valid_data && (idx == flash.app_data_active_copy_idx),
+        };
+
+        if (!flash_read_copy_meta_data(idx, &app_meta_data) ||
+            !flash_copy_crc(idx, &app_meta_data, &entry.crc_ok))
+        {
+            return flash_status_ll_read_fault;
+        }
+        entry.length       = app_meta_data.length;
+        entry.integrity_id = app_meta_data.integrity_id;
+
+        // Insert newest version first, the oldest drop off when info is short 
+        uint32_t pos = *num_info;
+        while ((pos > 0) && (info[pos - 1].version < entry.version))
+        {
+            if (pos < max_info)
+            {
+                info[pos] = info[pos - 1];
+            }
+            --pos;
+        }
+        if (pos < max_info)
+        {
+            info[pos] = entry;
+            if (*num_info < max_info)
+            {
+                ++(*num_info);
+            }
+        }
+    }
+
+    return flash_status_ok;
+}
+
+
+flash_status_t flash_read_version(uint32_t version, uint32_t offset, uint8_t* data, uint32_t num_bytes)
+{
+    assert(flash.initialized);
+    assert((data != NULL) || (num_bytes == 0));
+
+    if (!flash.initialized)
+    {
+        return flash_status_uninitialized;
+    }
+
+    int32_t copy_idx = flash_find_version(version);
+    if (copy_idx < 0)
+    {
+        return flash_status_version_not_found;
+    }
+
+    app_data_meta_t app_meta_data;
+    if (!flash_read_copy_meta_data((uint32_t)copy_idx, &app_meta_data))
+    {
+        return flash_status_ll_read_fault;
+    }
+
+    if (app_meta_data.length != flash.conf_ptr->data_descriptor.data_num_bytes)
+    {
+        return flash_status_data_corruption_detected;
+    }
+
+    if ((offset > app_meta_data.length) || (num_bytes > (app_meta_data.length - offset)))
+    {
+        return flash_status_total_size_exceeded;
+    }
+
+    if (num_bytes == 0)
+    {
+        return flash_status_ok;
+    }
+
+    uint32_t addr = flash.data_copies_base_addrs[copy_idx] + sizeof(app_data_meta_t) + offset;
+    if (ll_trace_read(addr, data, num_bytes) != ll_flash_status_ok)
+    {
+        return flash_status_ll_read_fault;
+    }
+
+    return flash_status_ok;
+}
+
+
+flash_status_t flash_rollback(uint32_t version)
+{
+    assert(flash.initialized);
+
+    if (!flash.initialized)
+    {
+        return flash_status_uninitialized;
+    }
+
+    int32_t copy_idx = flash_find_version(version);
+    if (copy_idx < 0)
+    {
+        return flash_status_version_not_found;
+    }
+
+    if (flash.has_valid_data && ((uint32_t)copy_idx == flash.app_data_active_copy_idx))
+    {
+        // Already active, nothing to program 
+        return flash_status_ok;
+    }
+
+    // Never activate a copy which would fail its integrity check on the next boot 
+    app_data_meta_t app_meta_data;
+    bool crc_ok = false;
+    if (!flash_read_copy_meta_data((uint32_t)copy_idx, &app_meta_data) ||
+        !flash_copy_crc((uint32_t)copy_idx, &app_meta_data, &crc_ok))
+    {
+        return flash_status_ll_read_fault;
+    }
+    if (!crc_ok)
+    {
+        flash.data_copies_health[copy_idx] = flash_health_corrupt;
+        return flash_status_crc_check_failure;
+    }
+
+    // First slot still fully erased, a torn slot is never reused 
+    uint32_t slot = FLASH_META_NUM_ACTIVATIONS;
+    for (uint32_t idx = 0; idx < FLASH_META_NUM_ACTIVATIONS; ++idx)
+    {
+        if ((app_meta_data.activations[idx].sequence == FLASH_SEQUENCE_ERASED) &&
+            (app_meta_data.activations[idx].inverse == FLASH_SEQUENCE_ERASED))
         {
+            slot = idx;
             break;
         }
-        else
+    }
+    if (slot == FLASH_META_NUM_ACTIVATIONS)
+    {
+        return flash_status_rollback_slots_exhausted;
+    }
+
+    assert(flash.next_sequence < FLASH_SEQUENCE_ERASED);
+    const app_data_activation_t activation = {
+        .sequence = flash.next_sequence,
+        .inverse  = ~flash.next_sequence,
+    };
+
+    // The whole roll-back, one slot of meta data 
+    uint32_t addr = flash.data_copies_base_addrs[copy_idx] +
+                    offsetof(app_data_meta_t, activations) + (slot * sizeof(app_data_activation_t));
+    if (ll_trace_write(addr, (const uint8_t*)&activation, sizeof(activation)) != ll_flash_status_ok)
+    {
+        return flash_status_ll_write_fault;
+    }
+
+    if (!flash_load_app_data_and_check_crc((uint32_t)copy_idx, &app_meta_data) ||
+        (flash_meta_activation(&app_meta_data) != activation.sequence))
+    {
+        return flash_status_ll_write_fault;
+    }
+
+    flash.conf_ptr->data_descriptor._app_data_meta = app_meta_data;
+    flash.data_copies_activation[copy_idx]        = activation.sequence;
+    flash.data_copies_health[copy_idx]            = flash_health_ok;
+    ++flash.next_sequence;
+
+    flash.app_data_active_copy_idx = (uint32_t)copy_idx;
+    flash.has_valid_data           = true;
+    return flash_status_ok;
+}
+
+
+flash_status_t flash_scrub_step(uint32_t budget_bytes)
+{
+    assert(flash.initialized);
+
+    if (!flash.initialized)
+    {
+        return flash_status_uninitialized;
+    }
+
+    flash_status_t status = flash_status_ok;
+    uint32_t num_skipped  = 0;
+    uint8_t chunk[FLASH_CRC_CHUNK_BYTES];
+
+    while (budget_bytes > 0)
+    {
+        if (flash.scrub.copy_idx == flash.num_copies)
+        {
+            // A whole lap without a copy to check, nothing is retained besides the active copy
+            if (num_skipped == flash.num_copies)
+            {
+                break;
+            }
+
+            uint32_t copy_idx = flash.scrub.next_copy_idx;
+            if ((flash.data_copies_version[copy_idx] == 0) ||
+                (flash.has_valid_data && (copy_idx == flash.app_data_active_copy_idx)))
+            {
+                // Nothing retained, or verified when it was loaded 
+                flash_scrub_advance();
+                ++num_skipped;
+                continue;
+            }
+            num_skipped = 0;
+
+            // The header is read in one go, it may take a call past its budget 
+            bool corrupt = false;
+            if (!flash_scrub_begin_copy(copy_idx, &corrupt))
+            {
+                return flash_status_ll_read_fault;
+            }
+            flash.scrub.stats.bytes_read += sizeof(app_data_meta_t);
+            budget_bytes -= (budget_bytes < sizeof(app_data_meta_t)) ? budget_bytes : sizeof(app_data_meta_t);
+
+            if (corrupt)
+            {
+                flash_scrub_record(true);
+                flash_scrub_advance();
+                status = flash_status_data_corruption_detected;
+            }
+            continue;
+        }
+
+        // A commit or rollback since the check began has made the copy a different
+        // version, or the active one, drop the partial check and look at it afresh
+        if ((flash.data_copies_version[flash.scrub.copy_idx] != flash.scrub.version) ||
+            (flash.has_valid_data && (flash.scrub.copy_idx == flash.app_data_active_copy_idx)))
         {
-            num_bytes_to_be_erased -= flash.conf_ptr->ll.page_descriptors[page_idx].size_bytes;
+            flash.scrub.copy_idx = flash.num_copies;
+            continue;
+        }
+
+        uint32_t num_bytes = flash.scrub.length - flash.scrub.offset;
+        num_bytes = (num_bytes < budget_bytes) ? num_bytes : budget_bytes;
+        num_bytes = (num_bytes < sizeof(chunk)) ? num_bytes : sizeof(chunk);
+
+        uint32_t addr = flash.data_copies_base_addrs[flash.scrub.copy_idx] + sizeof(app_data_meta_t) + flash.scrub.offset;
+        if (ll_trace_read(addr, chunk, num_bytes) != ll_flash_status_ok)
+        {
+            return flash_status_ll_read_fault;
+        }
+        flash.scrub.integrity->update(&flash.scrub.integrity_state, chunk, num_bytes);
+        flash.scrub.offset           += num_bytes;
+        flash.scrub.stats.bytes_read += num_bytes;
+        budget_bytes                 -= num_bytes;
+
+        if (flash.scrub.offset == flash.scrub.length)
+        {
+            bool corrupt = (flash.scrub.integrity->final(&flash.scrub.integrity_state) != flash.scrub.check);
+            flash_scrub_record(corrupt);
+            flash_scrub_advance();
+            if (corrupt)
+            {
+                status = flash_status_data_corruption_detected;
+            }
         }
     }
 
+    return status;
+}
+
+
+flash_status_t flash_version_health(uint32_t version, flash_health_t* health)
+{
+    assert(flash.initialized);
+    assert(health != NULL);
+
+    if (!flash.initialized)
+    {
+        return flash_status_uninitialized;
+    }
+
+    int32_t copy_idx = flash_find_version(version);
+    if (copy_idx < 0)
+    {
+        return flash_status_version_not_found;
+    }
+
+    *health = flash.data_copies_health[copy_idx];
+    return flash_status_ok;
+}
+
+
+void flash_scrub_stats(flash_scrub_stats_t* stats)
+{
+    assert(stats != NULL);
+    *stats = flash.scrub.stats;
+}
+
+
+// Erases copy_idx and commits the app_data segments into it as the next version.
+// RETURNS: ok once the copy is validated and active, else the failing step
+static flash_status_t flash_commit_copy(uint32_t copy_idx)
+{
+    flash_status_t status = flash_status_ok;
+
+    assert(copy_idx < flash.num_copies);
+    assert((flash.next_sequence > 0) && (flash.next_sequence < FLASH_SEQUENCE_ERASED));
+
+    // The version held by the target copy is gone from here on 
+    flash.data_copies_version[copy_idx]    = 0;
+    flash.data_copies_activation[copy_idx] = 0;
+
+    // Erase next app_data copy region 
+    if (!flash_erase_copy(copy_idx))
+    {
+        return flash_status_ll_erase_fault;
+    }
+
+    // Validity and activation slots are not part of the commit write, they stay erased 
+    app_data_meta_t new_app_meta_data;
+    memset(&new_app_meta_data, 0xFF, sizeof(new_app_meta_data));
+
     new_app_meta_data.validity = CFG_APP_DATA_VALID_CLEAR;
     new_app_meta_data.length   = flash.conf_ptr->data_descriptor.data_num_bytes;
-    new_app_meta_data.crc32    =
-        crc32(flash.conf_ptr->data_descriptor.app_data,
-              flash.conf_ptr->data_descriptor.data_num_bytes);
+    new_app_meta_data.sequence     = flash.next_sequence;
+    new_app_meta_data.integrity_id = flash.integrity->id;
+
+    flash_integrity_state_t integrity_state;
+    flash.integrity->begin(&integrity_state);
+    for (uint32_t seg_idx = 0; seg_idx < flash.num_segments; ++seg_idx)
+    {
+        flash.integrity->update(&integrity_state,
+                                flash.segments[seg_idx].data,
+                                flash.segments[seg_idx].num_bytes);
+    }
+    new_app_meta_data.check = flash.integrity->final(&integrity_state);
 
-    uint32_t addr = flash.data_copies_base_addrs[new_copy_base_page_idx];
-    ll_flash_status_t ll_status =
-        ll_flash_write(addr + sizeof(app_data_meta_t),
-                       flash.conf_ptr->data_descriptor.app_data,
-                       flash.conf_ptr->data_descriptor.data_num_bytes);
+    // Program meta data + segments straight from their buffers, back to back.
+    // A single transaction unless there are more segments than fit in one iov batch.
+    uint32_t addr = flash.data_copies_base_addrs[copy_idx] + FLASH_META_COMMIT_OFFSET;
+    ll_flash_status_t ll_status = flash_write_copy(addr, &new_app_meta_data);
 
     if (ll_status == ll_flash_status_ok)
     {
-        ll_status = ll_flash_write(addr, (uint8_t*)&new_app_meta_data, sizeof(app_data_meta_t));
-        if (ll_status == ll_flash_status_ok)
+        // Read back the meta data of newly written app_data and re-check its integrity 
+        if (flash_load_app_data_and_check_crc(copy_idx, &new_app_meta_data))
         {
-            // Read back the meta data of newly written app_data and eval CRC32 
-            if (flash_load_app_data_and_check_crc(new_copy_base_page_idx, &new_app_meta_data))
+            // Validate new app_data copy, the commit point. The previous copy
+            // keeps its validity and stays readable as an older version.
+            if (ll_trace_write(flash.data_copies_base_addrs[copy_idx],
+                               (const uint8_t*)&app_data_valid,
+                               sizeof(app_data_valid)) != ll_flash_status_ok)
             {
-                // Invalidate previous app_data copy 
-                ll_flash_write(
-                    flash.conf_ptr->ll.page_descriptors[flash.app_data_active_copy_base_page_idx].base_addr,
-                    (uint8_t*)&(uint32_t){CFG_APP_DATA_INVALID},
-                    sizeof(uint32_t));
-
-                // Validate new app_data copy 
-                ll_flash_write(
-                    flash.conf_ptr->ll.page_descriptors[new_copy_base_page_idx].base_addr,
-                    (uint8_t*)&(uint32_t){CFG_APP_DATA_VALID},
-                    sizeof(uint32_t));
-
-                flash.app_data_active_copy_base_page_idx = new_copy_base_page_idx;
-                status = flash_status_ok;
+                return flash_status_ll_write_fault;
             }
-            else
+
+            // Read the validity back before the copy counts as active, the commit only
+            // returns once its bank has finished programming, so reads of the new version
+            // never wait on it.
+            uint32_t validity;
+            if ((ll_trace_read(flash.data_copies_base_addrs[copy_idx], (uint8_t*)&validity,
+                               sizeof(validity)) != ll_flash_status_ok) ||
+                (validity != CFG_APP_DATA_VALID))
             {
-                status = flash_status_crc_check_failure;
+                return flash_status_ll_write_fault;
             }
+
+            new_app_meta_data.validity = CFG_APP_DATA_VALID;
+            flash.conf_ptr->data_descriptor._app_data_meta = new_app_meta_data;
+
+            flash.data_copies_version[copy_idx]    = flash.next_sequence;
+            flash.data_copies_activation[copy_idx] = flash.next_sequence;
+            flash.data_copies_health[copy_idx]     = flash_health_ok;
+            ++flash.next_sequence;
+
+            flash.app_data_active_copy_idx = copy_idx;
+            flash.has_valid_data           = true;
+            status = flash_status_ok;
         }
         else
         {
-            status = flash_status_ll_write_fault;                            
+            status = flash_status_crc_check_failure;
         }
     }
     else
@@ -283,6 +879,77 @@ flash_status_t flash_write(void)
     return status;
 }
 
+// Programs meta data (from length onwards) followed by every app_data segment from addr.
+// RETURNS: ll status of the first failing ll_flash_writev, else ok
+static ll_flash_status_t flash_write_copy(uint32_t addr, const app_data_meta_t* app_meta_data)
+{
+    ll_flash_iovec_t iov[FLASH_WRITEV_MAX_IOV];
+    uint32_t iov_count = 0;
+    uint32_t iov_bytes = 0;
+
+    iov[iov_count++] = (ll_flash_iovec_t){ .data      = (const uint8_t*)app_meta_data + FLASH_META_COMMIT_OFFSET,
+                                           .num_bytes = sizeof(app_data_meta_t) - FLASH_META_COMMIT_OFFSET };
+    iov_bytes += sizeof(app_data_meta_t) - FLASH_META_COMMIT_OFFSET;
+
+    for (uint32_t seg_idx = 0; seg_idx < flash.num_segments; ++seg_idx)
+    {
+        iov[iov_count++] = (ll_flash_iovec_t){ .data = flash.segments[seg_idx].data,
+                                               .num_bytes = flash.segments[seg_idx].num_bytes };
+        iov_bytes += flash.segments[seg_idx].num_bytes;
+
+        if ((iov_count == FLASH_WRITEV_MAX_IOV) || (seg_idx == (flash.num_segments - 1)))
+        {
+            ll_flash_status_t ll_status = ll_trace_writev(addr, iov, iov_count);
+            if (ll_status != ll_flash_status_ok)
+            {
+                return ll_status;
+            }
+            addr += iov_bytes;
+            iov_count = 0;
+            iov_bytes = 0;
+        }
+    }
+
+    return ll_flash_status_ok;
+}
+
+// Erases the pages of a copy region with the fewest erase ops. At each page take the
+// largest sector starting there which ends within the region, else erase the page alone.
+// Sectors are sorted by first page, so finding those starting at a page is a binary search.
+// RETURNS: true on success, else false on the first failing ll_flash_range_erase
+static bool flash_erase_copy(uint32_t copy_idx)
+{
+    assert(copy_idx < flash.num_copies);
+
+    const ll_flash_config_t* ll = &flash.conf_ptr->ll;
+    uint32_t page_idx = flash.data_copies_base_page_idx[copy_idx];
+    uint32_t end_idx  = page_idx + flash.data_copies_num_pages[copy_idx];
+    assert(end_idx <= ll->pages_total_num);
+
+    while (page_idx < end_idx)
+    {
+        uint32_t num_pages = 1;
+
+        for (uint32_t sector_idx = page_table_sector_lower_bound(ll->sector_descriptors, ll->sectors_total_num, page_idx);
+             (sector_idx < ll->sectors_total_num) && (ll->sector_descriptors[sector_idx].first_page_idx == page_idx);
+             ++sector_idx)
+        {
+            const sector_dsc_t* sector = &ll->sector_descriptors[sector_idx];
+            if ((sector->num_pages > num_pages) && (sector->num_pages <= (end_idx - page_idx)))
+            {
+                num_pages = sector->num_pages;
+            }
+        }
+
+        if (ll_trace_range_erase(page_idx, num_pages) != ll_flash_status_ok)
+        {
+            return false;
+        }
+        page_idx += num_pages;
+    }
+
+    return true;
+}
 
 // Returns the TOTAL size of an app_data copy region including meta data 
 static uint32_t flash_app_data_bytes_inc_meta(void)
@@ -296,10 +963,10 @@ static uint32_t flash_app_data_bytes_inc_meta(void)
 static bool flash_read_copy_meta_data(uint32_t copy_idx, app_data_meta_t* app_meta_data)
 {
     assert(app_meta_data != NULL);
-    assert(copy_idx < flash.conf_ptr->num_app_data_copies);
+    assert(copy_idx < flash.num_copies);
 
     // Read out meta data from base of specified page 
-    if (ll_flash_read(flash.data_copies_base_addrs[copy_idx],
+    if (ll_trace_read(flash.data_copies_base_addrs[copy_idx],
                       (uint8_t*)app_meta_data,
                       sizeof(app_data_meta_t)) != ll_flash_status_ok)
     {
@@ -308,38 +975,442 @@ static bool flash_read_copy_meta_data(uint32_t copy_idx, app_data_meta_t* app_me
     return true;
 }
 
-// Loads app_data_meta_t from flash, checks CRC32 consistency.
+// Loads app_data_meta_t from flash, checks app_data against it with the recorded algorithm.
 // RETURNS: true on success, else fail. TODO: Add return status granularity 
-static bool flash_load_app_data_and_check_crc(uint32_t page_idx, app_data_meta_t* app_data_meta)
+static bool flash_load_app_data_and_check_crc(uint32_t copy_idx, app_data_meta_t* app_data_meta)
 {
     assert(app_data_meta != NULL);
-    assert(page_idx < flash.conf_ptr->ll.pages_total_num);
+    assert(copy_idx < flash.num_copies);
 
-    uint32_t base_addr = flash.conf_ptr->ll.page_descriptors[page_idx].base_addr;
+    uint32_t base_addr = flash.data_copies_base_addrs[copy_idx];
     assert(base_addr >= flash.conf_ptr->ll.page_descriptors[CFG_APP_DATA_PAGE_ZERO].base_addr);
     assert(base_addr <= flash.conf_ptr->ll.page_descriptors[flash.conf_ptr->ll.pages_total_num - 1].base_addr);
 
-    if (ll_flash_read(base_addr + sizeof(app_data_meta_t),
-                      flash.conf_ptr->data_descriptor.app_data,
-                      flash.conf_ptr->data_descriptor.data_num_bytes) != ll_flash_status_ok)
+    if (ll_trace_read(base_addr, (uint8_t*)app_data_meta, sizeof(app_data_meta_t)) != ll_flash_status_ok)
     {
         return false;
     }
 
-    if (ll_flash_read(base_addr, (uint8_t*)app_data_meta, sizeof(app_data_meta_t)) != ll_flash_status_ok)
+    // A copy written by an algorithm we don't know can't be checked, treat it as corrupt
+    const flash_integrity_t* integrity = flash_integrity_lookup(app_data_meta->integrity_id);
+    if (integrity == NULL)
     {
         return false;
     }
 
-    // Compute CRC32 for the app_data range 
-    uint32_t _crc32 = crc32(flash.conf_ptr->data_descriptor.app_data,
-                            flash.conf_ptr->data_descriptor.data_num_bytes);
+    // Scatter the copy back into the app_data segments, checking as we go
+    uint32_t seg_addr = base_addr + sizeof(app_data_meta_t);
+    flash_integrity_state_t integrity_state;
+    integrity->begin(&integrity_state);
 
-    // Compare crc computed from read app data against the meta copy 
-    if (_crc32 == app_data_meta->crc32)
+    for (uint32_t seg_idx = 0; seg_idx < flash.num_segments; ++seg_idx)
+    {
+        const flash_data_seg_t* seg = &flash.segments[seg_idx];
+        if (seg->num_bytes == 0)
+        {
+            continue;
+        }
+
+        if (ll_trace_read(seg_addr, seg->data, seg->num_bytes) != ll_flash_status_ok)
+        {
+            return false;
+        }
+        integrity->update(&integrity_state, seg->data, seg->num_bytes);
+        seg_addr += seg->num_bytes;
+    }
+
+    // Compare the value computed from read app data against the meta copy 
+    if (integrity->final(&integrity_state) == app_data_meta->check)
     {
         return true;
     }
 
     return false;
 }
+
+// Latest activation of a copy, its commit sequence or a newer roll-back slot.
+// RETURNS: 0 when the copy holds no committed data
+static uint32_t flash_meta_activation(const app_data_meta_t* app_meta_data)
+{
+    assert(app_meta_data != NULL);
+
+    // A copy written before versioning has its length in the first pad word, never a commit
+    uint32_t pad_word;
+    memcpy(&pad_word, app_meta_data->_unit_pad, sizeof(pad_word));
+
+    if ((app_meta_data->validity != CFG_APP_DATA_VALID) ||
+        (pad_word != FLASH_SEQUENCE_ERASED) ||
+        (app_meta_data->sequence == 0) ||
+        (app_meta_data->sequence == FLASH_SEQUENCE_ERASED))
+    {
+        return 0;
+    }
+
+    uint32_t activation = app_meta_data->sequence;
+    for (uint32_t idx = 0; idx < FLASH_META_NUM_ACTIVATIONS; ++idx)
+    {
+        const app_data_activation_t* slot = &app_meta_data->activations[idx];
+        if ((slot->inverse == ~slot->sequence) && (slot->sequence > activation))
+        {
+            activation = slot->sequence;
+        }
+    }
+
+    return activation;
+}
+
+// Reads the meta data of every copy, ranks committed copies and picks the next sequence number
+static void flash_scan_copies(void)
+{
+    uint32_t latest = 0;
+
+    for (uint32_t idx = 0; idx < flash.num_copies; ++idx)
+    {
+        app_data_meta_t app_meta_data;
+        flash.data_copies_version[idx]    = 0;
+        flash.data_copies_activation[idx] = 0;
+
+        if (flash_read_copy_meta_data(idx, &app_meta_data))
+        {
+            flash.data_copies_activation[idx] = flash_meta_activation(&app_meta_data);
+            if (flash.data_copies_activation[idx] != 0)
+            {
+                flash.data_copies_version[idx] = app_meta_data.sequence;
+            }
+        }
+
+        if (flash.data_copies_activation[idx] > latest)
+        {
+            latest = flash.data_copies_activation[idx];
+        }
+    }
+
+    flash.next_sequence = latest + 1;
+}
+
+// RETURNS: copy index holding the committed version, else -1
+static int32_t flash_find_version(uint32_t version)
+{
+    if (version == 0)
+    {
+        return -1;
+    }
+
+    for (uint32_t idx = 0; idx < flash.num_copies; ++idx)
+    {
+        if (flash.data_copies_version[idx] == version)
+        {
+            return (int32_t)idx;
+        }
+    }
+
+    return -1;
+}
+
+// Streams a copy through its recorded integrity algorithm without touching app_data.
+// RETURNS: false on ll read failure, crc_ok holds the comparison against the meta data
+static bool flash_copy_crc(uint32_t copy_idx, const app_data_meta_t* app_data_meta, bool* crc_ok)
+{
+    assert(app_data_meta != NULL);
+    assert(crc_ok != NULL);
+    assert(copy_idx < flash.num_copies);
+
+    *crc_ok = false;
+
+    // A length which can't fit the copy region is corruption, don't read past it 
+    if (app_data_meta->length != flash.conf_ptr->data_descriptor.data_num_bytes)
+    {
+        return true;
+    }
+
+    const flash_integrity_t* integrity = flash_integrity_lookup(app_data_meta->integrity_id);
+    if (integrity == NULL)
+    {
+        return true;
+    }
+
+    uint8_t chunk[FLASH_CRC_CHUNK_BYTES];
+    uint32_t addr      = flash.data_copies_base_addrs[copy_idx] + sizeof(app_data_meta_t);
+    uint32_t remaining = app_data_meta->length;
+    flash_integrity_state_t integrity_state;
+    integrity->begin(&integrity_state);
+
+    while (remaining > 0)
+    {
+        uint32_t num_bytes = (remaining < sizeof(chunk)) ? remaining : sizeof(chunk);
+        if (ll_trace_read(addr, chunk, num_bytes) != ll_flash_status_ok)
+        {
+            return false;
+        }
+        integrity->update(&integrity_state, chunk, num_bytes);
+        addr      += num_bytes;
+        remaining -= num_bytes;
+    }
+
+    *crc_ok = (integrity->final(&integrity_state) == app_data_meta->check);
+    return true;
+}
+
+// Loads a copy written before versioning (app_data_meta_v0_t) from the base of page_idx
+// into the app_data segments.
+// RETURNS: True when it is valid, holds data_num_bytes within contiguous pages and its CRC32
+// passes, num_pages is set to the pages it spans
+static bool flash_load_v0_copy(uint32_t page_idx, uint32_t* num_pages)
+{
+    assert(page_idx < flash.conf_ptr->ll.pages_total_num);
+    assert(num_pages != NULL);
+
+    const ll_flash_config_t* ll = &flash.conf_ptr->ll;
+    app_data_meta_v0_t app_meta_data;
+
+    if ((ll_trace_read(ll->page_descriptors[page_idx].base_addr, (uint8_t*)&app_meta_data,
+                       sizeof(app_meta_data)) != ll_flash_status_ok) ||
+        (app_meta_data.validity != CFG_APP_DATA_VALID) ||
+        (app_meta_data.length != flash.conf_ptr->data_descriptor.data_num_bytes))
+    {
+        return false;
+    }
+
+    // The copy was written as one range, don't read past a gap or the last page
+    uint64_t copy_num_bytes = sizeof(app_meta_data) + (uint64_t)app_meta_data.length;
+    uint64_t span_num_bytes = 0;
+    uint32_t end_idx        = page_idx;
+    while ((span_num_bytes < copy_num_bytes) && (end_idx < ll->pages_total_num) &&
+           ((end_idx == page_idx) || page_table_is_contiguous(ll->page_descriptors + end_idx - 1, 2)))
+    {
+        span_num_bytes += ll->page_descriptors[end_idx++].size_bytes;
+    }
+    if (span_num_bytes < copy_num_bytes)
+    {
+        return false;
+    }
+    *num_pages = end_idx - page_idx;
+
+    uint32_t seg_addr = ll->page_descriptors[page_idx].base_addr + sizeof(app_meta_data);
+    flash_integrity_state_t integrity_state;
+    flash_integrity_crc32.begin(&integrity_state);
+
+    for (uint32_t seg_idx = 0; seg_idx < flash.num_segments; ++seg_idx)
+    {
+        const flash_data_seg_t* seg = &flash.segments[seg_idx];
+        if (seg->num_bytes == 0)
+        {
+            continue;
+        }
+
+        if (ll_trace_read(seg_addr, seg->data, seg->num_bytes) != ll_flash_status_ok)
+        {
+            return false;
+        }
+        flash_integrity_crc32.update(&integrity_state, seg->data, seg->num_bytes);
+        seg_addr += seg->num_bytes;
+    }
+
+    return flash_integrity_crc32.final(&integrity_state) == app_meta_data.crc32;
+}
+
+// Firmware before versioning kept one valid copy at a page base. Loads it and commits it
+// as the first version into a copy region sharing no page with it, so power loss part way
+// leaves the old copy for the next flash_init to retry from.
+// RETURNS: no_valid_data_found when there is no such copy, else the commit status. With no
+// region clear of the old copy the data is left loaded for the next flash_write to commit.
+static flash_status_t flash_migrate_v0(void)
+{
+    for (uint32_t page_idx = 0; page_idx < flash.conf_ptr->ll.pages_total_num; ++page_idx)
+    {
+        uint32_t num_pages;
+        if (!flash_load_v0_copy(page_idx, &num_pages))
+        {
+            continue;
+        }
+
+        for (uint32_t copy_idx = 0; copy_idx < flash.num_copies; ++copy_idx)
+        {
+            uint32_t base_page_idx = flash.data_copies_base_page_idx[copy_idx];
+            if ((base_page_idx >= (page_idx + num_pages)) ||
+                ((base_page_idx + flash.data_copies_num_pages[copy_idx]) <= page_idx))
+            {
+                return flash_commit_copy(copy_idx);
+            }
+        }
+
+        return flash_status_ok;
+    }
+
+    return flash_status_no_valid_data_found;
+}
+
+// Walks pages from *page_dsc_idx for the next run of contiguous pages in bank large enough
+// for a copy, *page_dsc_idx is left just past it.
+// RETURNS: False when the pages run out first
+static bool flash_place_copy(uint32_t bank, uint32_t* page_dsc_idx, uint32_t* base_page_idx)
+{
+    uint32_t bytes_spanned = 0;
+    *base_page_idx = *page_dsc_idx;
+
+    while ((bytes_spanned < flash_app_data_bytes_inc_meta()) &&
+           (*page_dsc_idx < flash.conf_ptr->ll.pages_total_num))
+    {
+        const page_dsc_t* page = &flash.conf_ptr->ll.page_descriptors[(*page_dsc_idx)++];
+        assert(page->size_bytes > 0);
+
+        if (page->bank != bank)
+        {
+            *base_page_idx = *page_dsc_idx;
+            bytes_spanned  = 0;
+            continue;
+        }
+
+        // A copy is addressed as one range, restart it past a gap in the address map
+        if ((bytes_spanned > 0) && (page[-1].base_addr + page[-1].size_bytes != page->base_addr))
+        {
+            *base_page_idx = *page_dsc_idx - 1;
+            bytes_spanned  = 0;
+        }
+        bytes_spanned += page->size_bytes;
+    }
+
+    return bytes_spanned >= flash_app_data_bytes_inc_meta();
+}
+
+// A copy_layout span must be whole pages within the page table, one contiguous range in
+// one bank, big enough for a copy and share no page with an earlier span.
+// RETURNS: True when the span of copy_num can be used as is
+static bool flash_copy_span_valid(uint32_t copy_num)
+{
+    assert(flash.conf_ptr->copy_layout != NULL);
+    assert(copy_num < flash.num_copies);
+
+    const ll_flash_config_t* ll   = &flash.conf_ptr->ll;
+    const flash_copy_span_t* span = &flash.conf_ptr->copy_layout[copy_num];
+
+    if ((span->num_pages == 0) || (span->base_page_idx >= ll->pages_total_num) ||
+        (span->num_pages > (ll->pages_total_num - span->base_page_idx)))
+    {
+        return false;
+    }
+
+    const page_dsc_t* pages = ll->page_descriptors + span->base_page_idx;
+    if (!page_table_is_contiguous(pages, span->num_pages) || !page_table_is_one_bank(pages, span->num_pages))
+    {
+        return false;
+    }
+
+    uint64_t span_num_bytes = (uint64_t)pages[span->num_pages - 1].base_addr +
+                              pages[span->num_pages - 1].size_bytes - pages[0].base_addr;
+    if (span_num_bytes < flash_app_data_bytes_inc_meta())
+    {
+        return false;
+    }
+
+    for (uint32_t prev_num = 0; prev_num < copy_num; ++prev_num)
+    {
+        const flash_copy_span_t* prev = &flash.conf_ptr->copy_layout[prev_num];
+        if ((span->base_page_idx < (prev->base_page_idx + prev->num_pages)) &&
+            (prev->base_page_idx < (span->base_page_idx + span->num_pages)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Counts the copies in each bank holding any.
+// RETURNS: True when every such bank holds the same number of copies
+static bool flash_copies_balanced(void)
+{
+    uint32_t first_count = 0;
+
+    for (uint32_t copy_idx = 0; copy_idx < flash.num_copies; ++copy_idx)
+    {
+        uint32_t count = 0;
+        for (uint32_t other_idx = 0; other_idx < flash.num_copies; ++other_idx)
+        {
+            count += (flash.data_copies_bank[other_idx] == flash.data_copies_bank[copy_idx]) ? 1 : 0;
+        }
+        if (first_count == 0)
+        {
+            first_count = count;
+        }
+        if (count != first_count)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Reads the header of a copy and starts its check. A header which no longer describes
+// the version the copy was ranked with, a bad length or an unknown algorithm is corrupt.
+// RETURNS: false on ll read failure
+static bool flash_scrub_begin_copy(uint32_t copy_idx, bool* corrupt)
+{
+    assert(copy_idx < flash.num_copies);
+    assert(corrupt != NULL);
+
+    app_data_meta_t app_meta_data;
+    if (!flash_read_copy_meta_data(copy_idx, &app_meta_data))
+    {
+        return false;
+    }
+
+    flash.scrub.copy_idx  = copy_idx;
+    flash.scrub.version   = flash.data_copies_version[copy_idx];
+    flash.scrub.offset    = 0;
+    flash.scrub.length    = app_meta_data.length;
+    flash.scrub.check     = app_meta_data.check;
+    flash.scrub.integrity = flash_integrity_lookup(app_meta_data.integrity_id);
+
+    *corrupt = (flash_meta_activation(&app_meta_data) == 0) ||
+               (app_meta_data.sequence != flash.scrub.version) ||
+               (app_meta_data.length != flash.conf_ptr->data_descriptor.data_num_bytes) ||
+               (flash.scrub.integrity == NULL);
+    if (!*corrupt)
+    {
+        flash.scrub.integrity->begin(&flash.scrub.integrity_state);
+    }
+    return true;
+}
+
+// Records the result of the check of scrub.copy_idx
+static void flash_scrub_record(bool corrupt)
+{
+    assert(flash.scrub.copy_idx < flash.num_copies);
+
+    flash.data_copies_health[flash.scrub.copy_idx] = corrupt ? flash_health_corrupt : flash_health_ok;
+    ++flash.scrub.stats.copies_checked;
+    flash.scrub.stats.copies_corrupt += corrupt;
+}
+
+// Moves the walk past next_copy_idx, a lap of the copies is a pass
+static void flash_scrub_advance(void)
+{
+    flash.scrub.copy_idx      = flash.num_copies;
+    flash.scrub.next_copy_idx = (flash.scrub.next_copy_idx + 1) % flash.num_copies;
+    if (flash.scrub.next_copy_idx == 0)
+    {
+        ++flash.scrub.stats.passes;
+    }
+}
+
+// RETURNS: algorithm for an id recorded in a copy header, NULL if not known to this build
+static const flash_integrity_t* flash_integrity_lookup(uint32_t id)
+{
+    if (id == flash.integrity->id)
+    {
+        return flash.integrity;
+    }
+
+    for (uint32_t idx = 0; idx < flash.conf_ptr->num_integrity_algs; ++idx)
+    {
+        const flash_integrity_t* integrity = flash.conf_ptr->integrity_algs[idx];
+        if ((integrity != NULL) && (integrity->id == id))
+        {
+            return integrity;
+        }
+    }
+
+    return flash_integrity_builtin(id);
+}
@@ -0,0 +1,80 @@
+#include <stddef.h>
+#include "crc.h"
+#include "flash_integrity.h"
+
+/*
+    Built-in integrity algorithms, thin adapters over crc_lib.
+*/
+
+static void crc32_begin(flash_integrity_state_t* state)
+{
+    state->crc = 0;
+}
+
+static void crc32_update_state(flash_integrity_state_t* state, const uint8_t* data, uint32_t num_bytes)
+{
+    state->crc = crc32_update(state->crc, data, num_bytes);
+}
+
+static uint64_t crc_final(flash_integrity_state_t* state)
+{
+    return state->crc;
+}
+
+static void crc32c_update_state(flash_integrity_state_t* state, const uint8_t* data, uint32_t num_bytes)
+{
+    state->crc = crc32c_update(state->crc, data, num_bytes);
+}
+
+static void xxh64_begin(flash_integrity_state_t* state)
+{
+    xxh64_reset(&state->xxh64, 0);
+}
+
+static void xxh64_update_state(flash_integrity_state_t* state, const uint8_t* data, uint32_t num_bytes)
+{
+    xxh64_update(&state->xxh64, data, num_bytes);
+}
+
+static uint64_t xxh64_final(flash_integrity_state_t* state)
+{
+    return xxh64_digest(&state->xxh64);
+}
+
+const flash_integrity_t flash_integrity_crc32 =
+{
+    .id     = FLASH_INTEGRITY_ID_CRC32,
+    .name   = "crc32",
+    .begin  = crc32_begin,
+    .update = crc32_update_state,
+    .final  = crc_final,
+};
+
+const flash_integrity_t flash_integrity_crc32c =
+{
+    .id     = FLASH_INTEGRITY_ID_CRC32C,
+    .name   = "crc32c",
+    .begin  = crc32_begin,
+    .update = crc32c_update_state,
+    .final  = crc_final,
+};
+
+const flash_integrity_t flash_integrity_xxh64 =
+{
+    .id     = FLASH_INTEGRITY_ID_XXH64,
+    .name   = "xxh64",
+    .begin  = xxh64_begin,
+    .update = xxh64_update_state,
+    .final  = xxh64_final,
+};
+
+const flash_integrity_t* flash_integrity_builtin(uint32_t id)
+{
+    switch (id)
+    {
+        case FLASH_INTEGRITY_ID_CRC32:  return &flash_integrity_crc32;
+        case FLASH_INTEGRITY_ID_CRC32C: return &flash_integrity_crc32c;
+        case FLASH_INTEGRITY_ID_XXH64:  return &flash_integrity_xxh64;
+        default:                        return NULL;
+    }
+}
@@ -0,0 +1,167 @@
+#include <assert.h>
+#include <stddef.h>
+#include "crc.h"
+#include "ll_flash_trace.h"
+
+/*
+    ll_flash call tracing, see ll_flash_trace.h for the record format.
+
+    When no trace is running each wrapper is a flag test and a call straight
+    through to ll_flash_*, so the flash module always calls through here.
+*/
+
+static struct {
+    bool active;
+    ll_trace_config_t conf;
+    const ll_flash_config_t* ll_conf; // geometry, known once ll_trace_init has run
+} trace;
+
+static uint32_t trace_now(void)
+{
+    return (trace.conf.clock != NULL) ? trace.conf.clock() : 0;
+}
+
+// end is taken by the caller before any hashing, so durations are the ll op alone
+static void trace_emit(ll_trace_op_t op, ll_flash_status_t status, uint32_t addr, uint32_t num_bytes,
+                       uint32_t start, uint32_t end, uint32_t hash)
+{
+    const ll_trace_record_t record = {
+        .op        = (uint8_t)op,
+        .status    = (uint8_t)status,
+        .addr      = addr,
+        .num_bytes = num_bytes,
+        .start     = start,
+        .duration  = end - start,
+        .hash      = hash,
+    };
+    trace.conf.sink((const uint8_t*)&record, sizeof(record), trace.conf.sink_ctx);
+}
+
+static void trace_emit_geometry(void)
+{
+    const ll_flash_config_t* ll = trace.ll_conf;
+    const ll_trace_record_t record = {
+        .op        = (uint8_t)ll_trace_op_geometry,
+        .aux       = (uint16_t)ll->write_granularity,
+        .addr      = ll->pages_total_num,
+        .num_bytes = ll->sectors_total_num,
+    };
+
+    trace.conf.sink((const uint8_t*)&record, sizeof(record), trace.conf.sink_ctx);
+    trace.conf.sink((const uint8_t*)ll->page_descriptors, ll->pages_total_num * sizeof(page_dsc_t), trace.conf.sink_ctx);
+    if (ll->sectors_total_num > 0)
+    {
+        trace.conf.sink((const uint8_t*)ll->sector_descriptors, ll->sectors_total_num * sizeof(sector_dsc_t),
+                        trace.conf.sink_ctx);
+    }
+}
+
+void ll_trace_start(const ll_trace_config_t* config)
+{
+    assert(config != NULL);
+    assert(config->sink != NULL);
+
+    ll_trace_stop();
+    trace.conf = *config;
+
+    const ll_trace_header_t header = {
+        .magic            = LL_TRACE_MAGIC,
+        .version          = LL_TRACE_VERSION,
+        .record_num_bytes = sizeof(ll_trace_record_t),
+        .clock_hz         = (config->clock != NULL) ? config->clock_hz : 0,
+        .flags            = config->hash_payloads ? LL_TRACE_FLAG_HASHES : 0,
+    };
+    trace.conf.sink((const uint8_t*)&header, sizeof(header), trace.conf.sink_ctx);
+
+    if (trace.ll_conf != NULL)
+    {
+        trace_emit_geometry();
+    }
+    trace.active = true;
+}
+
+void ll_trace_stop(void)
+{
+    trace.active = false;
+}
+
+bool ll_trace_active(void)
+{
+    return trace.active;
+}
+
+ll_flash_status_t ll_trace_init(ll_flash_config_t* ll_config)
+{
+    trace.ll_conf = ll_config;
+    if (!trace.active)
+    {
+        return ll_flash_init(ll_config);
+    }
+
+    trace_emit_geometry();
+    uint32_t start = trace_now();
+    ll_flash_status_t status = ll_flash_init(ll_config);
+    trace_emit(ll_trace_op_init, status, 0, 0, start, trace_now(), 0);
+    return status;
+}
+
+ll_flash_status_t ll_trace_read(uint32_t addr, uint8_t* data, uint32_t num_bytes)
+{
+    if (!trace.active)
+    {
+        return ll_flash_read(addr, data, num_bytes);
+    }
+
+    uint32_t start = trace_now();
+    ll_flash_status_t status = ll_flash_read(addr, data, num_bytes);
+    uint32_t end = trace_now();
+
+    uint32_t hash = (trace.conf.hash_payloads && (status == ll_flash_status_ok)) ? crc32(data, num_bytes) : 0;
+    trace_emit(ll_trace_op_read, status, addr, num_bytes, start, end, hash);
+    return status;
+}
+
+ll_flash_status_t ll_trace_write(uint32_t addr, const uint8_t* data, uint32_t num_bytes)
+{
+    const ll_flash_iovec_t iov = { .data = data, .num_bytes = num_bytes };
+    return ll_trace_writev(addr, &iov, 1);
+}
+
+ll_flash_status_t ll_trace_writev(uint32_t addr, const ll_flash_iovec_t* iov, uint32_t iov_count)
+{
+    if (!trace.active)
+    {
+        return ll_flash_writev(addr, iov, iov_count);
+    }
+
+    uint32_t start = trace_now();
+    ll_flash_status_t status = ll_flash_writev(addr, iov, iov_count);
+    uint32_t end = trace_now();
+
+    // Hash of what was asked to be programmed, vectored writes hash as one buffer
+    uint32_t num_bytes = 0;
+    uint32_t hash = 0;
+    for (uint32_t idx = 0; idx < iov_count; ++idx)
+    {
+        num_bytes += iov[idx].num_bytes;
+        if (trace.conf.hash_payloads && (iov[idx].num_bytes > 0))
+        {
+            hash = crc32_update(hash, iov[idx].data, iov[idx].num_bytes);
+        }
+    }
+    trace_emit(ll_trace_op_write, status, addr, num_bytes, start, end, hash);
+    return status;
+}
+
+ll_flash_status_t ll_trace_range_erase(uint32_t first_page_idx, uint32_t page_count)
+{
+    if (!trace.active)
+    {
+        return ll_flash_range_erase(first_page_idx, page_count);
+    }
+
+    uint32_t start = trace_now();
+    ll_flash_status_t status = ll_flash_range_erase(first_page_idx, page_count);
+    trace_emit(ll_trace_op_erase, status, first_page_idx, page_count, start, trace_now(), 0);
+    return status;
+}
@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <stddef.h>
+#include "page_table.h"
+
+/*
+    Sorted page table, shared by the flash module and the ll stub.
+
+    Uniform geometry (all pages one size, no gaps) resolves an address with a
+    single division. Anything else falls back to a binary search for the last
+    page whose base_addr is <= addr, then a bounds check against its size.
+*/
+
+bool page_table_init(page_table_t* table, const page_dsc_t* pages, uint32_t num_pages)
+{
+    assert(table != NULL);
+    assert(pages != NULL);
+    assert(num_pages > 0);
+
+    table->pages             = pages;
+    table->num_pages         = num_pages;
+    table->uniform_page_size = 0;
+
+    bool uniform = true;
+    for (uint32_t page_idx = 0; page_idx < num_pages; ++page_idx)
+    {
+        if (pages[page_idx].size_bytes == 0)
+        {
+            return false;
+        }
+
+        if (page_idx > 0)
+        {
+            const page_dsc_t* prev = &pages[page_idx - 1];
+            uint64_t prev_end = (uint64_t)prev->base_addr + prev->size_bytes;
+            if (pages[page_idx].base_addr < prev_end)
+            {
+                return false;
+            }
+
+            uniform = uniform && (pages[page_idx].base_addr == prev_end) &&
+                      (pages[page_idx].size_bytes == pages[0].size_bytes);
+        }
+    }
+
+    if (((uint64_t)pages[num_pages - 1].base_addr + pages[num_pages - 1].size_bytes) > ((uint64_t)UINT32_MAX + 1))
+    {
+        return false;
+    }
+
+    if (uniform)
+    {
+        table->uniform_page_size = pages[0].size_bytes;
+    }
+    return true;
+}
+
+bool page_table_lookup(const page_table_t* table, uint32_t addr, uint32_t* page_idx, uint32_t* page_offset)
+{
+    assert(table != NULL);
+    assert(table->pages != NULL);
+    assert(page_idx != NULL);
+    assert(page_offset != NULL);
+
+    const page_dsc_t* pages = table->pages;
+    if (addr < pages[0].base_addr)
+    {
+        return false;
+    }
+
+    uint32_t idx;
+    if (table->uniform_page_size != 0)
+    {
+        idx = (addr - pages[0].base_addr) / table->uniform_page_size;
+        if (idx >= table->num_pages)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // Last page with base_addr <= addr
+        uint32_t lo = 0, hi = table->num_pages;
+        while ((hi - lo) > 1)
+        {
+            uint32_t mid = lo + ((hi - lo) / 2);
+            if (pages[mid].base_addr <= addr)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        idx = lo;
+
+        // addr may sit in a gap after the page
+        if ((addr - pages[idx].base_addr) >= pages[idx].size_bytes)
+        {
+            return false;
+        }
+    }
+
+    *page_idx    = idx;
+    *page_offset = addr - pages[idx].base_addr;
+    return true;
+}
+
+uint32_t page_table_sector_lower_bound(const sector_dsc_t* sectors, uint32_t num_sectors, uint32_t first_page_idx)
+{
+    assert((sectors != NULL) || (num_sectors == 0));
+
+    uint32_t lo = 0, hi = num_sectors;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + ((hi - lo) / 2);
+        if (sectors[mid].first_page_idx < first_page_idx)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    if ((lo < num_sectors) && (sectors[lo].first_page_idx == first_page_idx))
+    {
+        return lo;
+    }
+    return num_sectors;
+}
+
+bool page_table_is_contiguous(const page_dsc_t* pages, uint32_t num_pages)
+{
+    assert((pages != NULL) || (num_pages == 0));
+
+    for (uint32_t idx = 1; idx < num_pages; ++idx)
+    {
+        if ((pages[idx - 1].base_addr + pages[idx - 1].size_bytes) != pages[idx].base_addr)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool page_table_is_one_bank(const page_dsc_t* pages, uint32_t num_pages)
+{
+    assert((pages != NULL) || (num_pages == 0));
+
+    for (uint32_t idx = 1; idx < num_pages; ++idx)
+    {
+        if (pages[idx].bank != pages[0].bank)
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+    Opcode dispatcher driving the flash module.
+
+    Built both as a static lib (linked by main.c, one process per opcode
+    sequence) and as a shared lib (libflash_harness.so) so python can drive
+    it in-process via ctypes, see python/flash_test.py.
+*/
+
+// Opcode values are shared with python (CMD enum in flash_test.py)
+typedef enum
+{
+    harness_op_init,
+    harness_op_write,
+    harness_op_update_app_data,
+    harness_op_init_app_data,
+} harness_opcode_t;
+
+#define HARNESS_OP_UNRECOGNISED (-1)
+
+/*
+    Resets the flash module so the next INIT behaves like a power cycle.
+    INPUT: True to persist flash to nv_state on every op (CLI behaviour),
+           false to keep the faux flash in memory only.
+*/
+void harness_reset(bool persistent);
+
+/*
+    Enables / disables console output of op results (enabled by default).
+*/
+void harness_set_verbose(bool verbose);
+
+/*
+    Executes a single opcode.
+    RETURNS: flash_status_t of the op (flash_status_ok for app data ops,
+             or on failure to stage an update a non-zero status),
+             HARNESS_OP_UNRECOGNISED for an unknown opcode.
+*/
+int32_t harness_dispatch(uint32_t opcode);
+
+/*
+    Executes a sequence of opcodes, stops at the first unrecognised one.
+    RETURNS: Number of ops that did not return flash_status_ok
+*/
+uint32_t harness_run(const uint32_t* opcodes, uint32_t num_opcodes);
+
+/*
+    Stages new app data, applied by the next UPDATE_APP_DATA op.
+    Bytes beyond num_bytes keep their current value.
+    RETURNS: True on success, false if num_bytes exceeds the app data length
+*/
+bool harness_stage_app_data(const uint8_t* data, uint32_t num_bytes);
+
+/*
+    Direct access to the app data buffer registered with the flash module.
+*/
+uint8_t* harness_app_data(void);
+uint32_t harness_app_data_len(void);
+
+/*
+    Reads the faux flash via the ll driver (absolute flash addresses).
+    RETURNS: True on success, else False
+*/
+bool harness_flash_read(uint32_t addr, uint8_t* data, uint32_t num_bytes);
+
+/*
+    Flips bits of one byte of the faux flash (bit rot), bypassing program semantics.
+    RETURNS: True on success, else False (addr outside the flash, stub image error)
+*/
+bool harness_flash_corrupt(uint32_t addr, uint8_t xor_mask);
+
+/*
+    Overwrites faux flash bytes as is, bypassing program semantics (images
+    written by older firmware). Bytes all 0xFF make a page read as erased.
+    RETURNS: True on success, else False (range outside the flash, stub image error)
+*/
+bool harness_flash_poke(uint32_t addr, const uint8_t* data, uint32_t num_bytes);
+
+/*
+    Header size for tests which read or rebuild copies in the faux flash, app_data_meta_t
+    sits ahead of the app data.
+*/
+uint32_t harness_meta_num_bytes(void);
+
+/*
+    Finds the copy holding a committed version by its header, copies start on a page.
+    RETURNS: True with the copy's base address, else False (no copy holds the version)
+*/
+bool harness_version_addr(uint32_t version, uint32_t* addr);
+
+/*
+    Records the ll_flash ops of every following opcode to a trace file
+    (microsecond timestamps), replayable with tools/trace_replay.
+    INPUT: hash_payloads adds a CRC32 of the data of every read / write
+    RETURNS: True on success, else False (file could not be created)
+*/
+bool harness_trace_start(const char* path, bool hash_payloads);
+void harness_trace_stop(void);
+
+/*
+    Selects the built-in integrity algorithm (FLASH_INTEGRITY_ID_*) for commits
+    made after the next INIT, copies already written keep their own.
+    RETURNS: True on success, false for an unknown id
+*/
+bool harness_set_integrity(uint32_t integrity_id);
+
+#endif
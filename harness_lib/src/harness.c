@@ -0,0 +1,454 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "harness.h"
+#include "flash.h"
+#include "flash_conf.h"
+#include "ll_flash_stub.h"
+#include "file_io.h"
+#include "ll_flash_trace.h"
+
+/*
+A test harness for the flash driver module.
+
+Holds the app-level flash configuration and the test app data, and
+dispatches opcodes which drive the flash api and manipulate app data.
+
+UPDATE_APP_DATA applies data staged via harness_stage_app_data, when
+nothing has been staged (CLI) the update is read from APP_DATA_UPDATE_FILE
+which python writes before running the opcode sequence.
+*/
+
+#define APP_DATA_UPDATE_FILE "app_data_update"
+
+static flash_status_t _flash_init(flash_config_t*);
+static flash_status_t _flash_write(void);
+
+// For testing only - some super important
+// app data imitation for testing flash module
+#define TEST_DATA_LEN NUM_KB_TO_NUM_BYTE(134)
+static uint8_t test_data_a[TEST_DATA_LEN];
+
+// Staged UPDATE_APP_DATA contents
+static uint8_t  staged_data[TEST_DATA_LEN];
+static uint32_t staged_num_bytes;
+
+static bool verbose = true;
+
+static FILE* trace_file = NULL;
+
+// Flash app-level configuration
+static flash_config_t flash_config =
+{
+    // TODO: Update to include the following:
+    // - max_app_data_size (sets aside extra data for expansion!)
+    // - add separate app_data_base_ptr and meta_app_data_base_ptr
+	.num_app_data_copies = CFG_APP_DATA_NUM_COPIES,
+	.data_descriptor = {
+            // Test data is described as two segments (as if owned by two
+            // subsystems) so every harness run exercises scatter-gather
+			.segments = (const flash_data_seg_t[]){
+                { .data = test_data_a,                     .num_bytes = TEST_DATA_LEN / 2 },
+                { .data = test_data_a + TEST_DATA_LEN / 2, .num_bytes = TEST_DATA_LEN - TEST_DATA_LEN / 2 },
+            },
+			.num_segments = 2,
+	},
+
+    // The ll (low-level) configuration.
+
+    // If the flash has keys we can have them
+    // on hand ready to iterate through reg writes
+    .ll.num_flash_keys = CFG_NUM_FLASH_KEYS,
+    .ll.write_granularity = write_size_128bit,
+    .ll.flash_keys = (const uint32_t[CFG_NUM_FLASH_KEYS]){CFG_FLASH_KEY1, CFG_FLASH_KEY2},
+
+    // Sectors group consecutive pages (below) which can be erased
+    // in one operation, flash_init plans copy erases around them.
+    .ll.sectors_total_num = CFG_NUM_SECTORS,
+    .ll.sector_descriptors = (const sector_dsc_t[CFG_NUM_SECTORS]){
+        { .first_page_idx = CFG_SECTOR1_FIRST_PAGE, .num_pages = CFG_SECTOR1_NUM_PAGES },
+        { .first_page_idx = CFG_SECTOR2_FIRST_PAGE, .num_pages = CFG_SECTOR2_NUM_PAGES },
+        { .first_page_idx = CFG_SECTOR3_FIRST_PAGE, .num_pages = CFG_SECTOR3_NUM_PAGES },
+    },
+
+    // By having an array of page descriptors we have all the
+    // page base addresses and respective sizes on hand at runtime.
+    // Also solves problem of system with various page sizes.
+    .ll.pages_total_num = CFG_NUM_PAGES,
+    .ll.page_descriptors = (const page_dsc_t[CFG_NUM_PAGES]){
+        {
+            .base_addr = CFG_PAGE1_BASE_ADDR,
+            .size_bytes = CFG_PAGE1_NUM_BYTES,
+        },
+        {
+            .base_addr = CFG_PAGE2_BASE_ADDR,
+            .size_bytes = CFG_PAGE2_NUM_BYTES,
+        },
+        {
+            .base_addr = CFG_PAGE3_BASE_ADDR,
+            .size_bytes = CFG_PAGE3_NUM_BYTES,
+        },
+        {
+            .base_addr = CFG_PAGE4_BASE_ADDR,
+            .size_bytes = CFG_PAGE4_NUM_BYTES,
+        },
+        {
+            .base_addr = CFG_PAGE5_BASE_ADDR,
+            .size_bytes = CFG_PAGE5_NUM_BYTES,
+        },
+        {
+            .base_addr = CFG_PAGE6_BASE_ADDR,
+            .size_bytes = CFG_PAGE6_NUM_BYTES,
+        },
+    },
+};
+
+// Init some test data to work on
+static void init_test_data(void)
+{
+    // Fill with sequential non-zero values
+    for(uint32_t idx = 0; idx < TEST_DATA_LEN; ++idx)
+    {
+        test_data_a[idx] = (idx + 1);
+    }
+}
+
+// Apply staged data (or the python produced file) to the app data
+static bool update_test_data(void)
+{
+    if(staged_num_bytes == 0)
+    {
+        if(!load_file(APP_DATA_UPDATE_FILE, staged_data, TEST_DATA_LEN, &staged_num_bytes))
+        {
+            return false;
+        }
+    }
+
+    memcpy(test_data_a, staged_data, staged_num_bytes);
+    staged_num_bytes = 0;
+    return true;
+}
+
+void harness_reset(bool persistent)
+{
+    flash_deinit();
+    ll_flash_stub_set_persistence(persistent);
+    flash_config.integrity = NULL;
+
+    // Program like real NOR with one-shot ECC words, a layout needing a 0->1
+    // program or a second program of a word without an erase fails the write
+    const ll_flash_stub_program_mode_t nor_mode = { .nor = true, .once_per_word = true, .strict = true };
+    ll_flash_stub_set_program_mode(&nor_mode);
+    ll_flash_stub_clear_program_stats();
+    staged_num_bytes = 0;
+}
+
+void harness_set_verbose(bool enable)
+{
+    verbose = enable;
+}
+
+int32_t harness_dispatch(uint32_t opcode)
+{
+    switch(opcode)
+    {
+        case harness_op_init:
+            if(verbose) printf("main: attempting flash initialization\n");
+            // Re-init models a power cycle
+            flash_deinit();
+            return _flash_init(&flash_config);
+
+        case harness_op_write:
+            if(verbose) printf("main: attempting flash write op\n");
+            return _flash_write();
+
+        case harness_op_update_app_data:
+            if(verbose) printf("main: updating test data\n");
+            if(!update_test_data())
+            {
+                if(verbose) printf("main: update failed, nothing staged and no " APP_DATA_UPDATE_FILE " file\n");
+                return flash_status_no_valid_data_found;
+            }
+            return flash_status_ok;
+
+        case harness_op_init_app_data:
+            if(verbose) printf("main: initializing test data\n");
+            init_test_data();
+            return flash_status_ok;
+
+        default:
+            if(verbose) printf("main: unrecognised opcode\n");
+            return HARNESS_OP_UNRECOGNISED;
+    }
+}
+
+uint32_t harness_run(const uint32_t* opcodes, uint32_t num_opcodes)
+{
+    uint32_t num_failed = 0;
+
+    for(uint32_t idx = 0; idx < num_opcodes; ++idx)
+    {
+        int32_t status = harness_dispatch(opcodes[idx]);
+        if(status == HARNESS_OP_UNRECOGNISED)
+        {
+            return num_failed + (num_opcodes - idx);
+        }
+        if(status != flash_status_ok)
+        {
+            ++num_failed;
+        }
+    }
+
+    return num_failed;
+}
+
+bool harness_stage_app_data(const uint8_t* data, uint32_t num_bytes)
+{
+    if((data == NULL) || (num_bytes == 0) || (num_bytes > TEST_DATA_LEN))
+    {
+        return false;
+    }
+
+    memcpy(staged_data, data, num_bytes);
+    staged_num_bytes = num_bytes;
+    return true;
+}
+
+uint8_t* harness_app_data(void)
+{
+    return test_data_a;
+}
+
+uint32_t harness_app_data_len(void)
+{
+    return TEST_DATA_LEN;
+}
+
+bool harness_flash_read(uint32_t addr, uint8_t* data, uint32_t num_bytes)
+{
+    return (ll_flash_read(addr, data, num_bytes) == ll_flash_status_ok);
+}
+
+// Image offset of addr, pages are packed back to back in descriptor order.
+// RETURNS: False when addr is outside every page, else True with the bytes left in its page
+static bool image_offset(uint32_t addr, uint32_t* offset, uint32_t* num_bytes_in_page)
+{
+    *offset = 0;
+    for(uint32_t page_idx = 0; page_idx < flash_config.ll.pages_total_num; ++page_idx)
+    {
+        const page_dsc_t* page = &flash_config.ll.page_descriptors[page_idx];
+        if((addr >= page->base_addr) && ((addr - page->base_addr) < page->size_bytes))
+        {
+            *offset += addr - page->base_addr;
+            *num_bytes_in_page = page->size_bytes - (addr - page->base_addr);
+            return true;
+        }
+        *offset += page->size_bytes;
+    }
+    return false;
+}
+
+bool harness_flash_corrupt(uint32_t addr, uint8_t xor_mask)
+{
+    uint32_t offset, num_bytes_in_page;
+    if(!image_offset(addr, &offset, &num_bytes_in_page))
+    {
+        return false;
+    }
+
+    uint8_t* image = malloc(ll_flash_stub_image_num_bytes());
+    bool ok = (image != NULL) && ll_flash_stub_image_export(image);
+    if(ok)
+    {
+        image[offset] ^= xor_mask;
+        ok = ll_flash_stub_image_import(image);
+    }
+    free(image);
+    return ok;
+}
+
+bool harness_flash_poke(uint32_t addr, const uint8_t* data, uint32_t num_bytes)
+{
+    uint8_t* image = malloc(ll_flash_stub_image_num_bytes());
+    bool ok = (image != NULL) && ll_flash_stub_image_export(image);
+
+    // A page at a time, the range may span pages but not a gap between them
+    while(ok && (num_bytes > 0))
+    {
+        uint32_t offset, len;
+        ok = image_offset(addr, &offset, &len);
+        if(ok)
+        {
+            len = (len < num_bytes) ? len : num_bytes;
+            memcpy(image + offset, data, len);
+            addr      += len;
+            data      += len;
+            num_bytes -= len;
+        }
+    }
+
+    ok = ok && ll_flash_stub_image_import(image);
+    free(image);
+    return ok;
+}
+
+uint32_t harness_meta_num_bytes(void)
+{
+    return sizeof(app_data_meta_t);
+}
+
+bool harness_version_addr(uint32_t version, uint32_t* addr)
+{
+    for(uint32_t page_idx = 0; page_idx < flash_config.ll.pages_total_num; ++page_idx)
+    {
+        const page_dsc_t* page = &flash_config.ll.page_descriptors[page_idx];
+        app_data_meta_t meta;
+        if((page->size_bytes < sizeof(meta)) ||
+           (ll_flash_read(page->base_addr, (uint8_t*)&meta, sizeof(meta)) != ll_flash_status_ok))
+        {
+            continue;
+        }
+        if((meta.validity == CFG_APP_DATA_VALID) && (meta.sequence == version))
+        {
+            *addr = page->base_addr;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void trace_sink(const uint8_t* bytes, uint32_t num_bytes, void* ctx)
+{
+    fwrite(bytes, 1, num_bytes, (FILE*)ctx);
+}
+
+static uint32_t trace_clock_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u);
+}
+
+bool harness_trace_start(const char* path, bool hash_payloads)
+{
+    harness_trace_stop();
+
+    trace_file = fopen(path, "wb");
+    if(trace_file == NULL)
+    {
+        return false;
+    }
+
+    const ll_trace_config_t trace_config = {
+        .sink          = trace_sink,
+        .sink_ctx      = trace_file,
+        .clock         = trace_clock_us,
+        .clock_hz      = 1000000,
+        .hash_payloads = hash_payloads,
+    };
+    ll_trace_start(&trace_config);
+    return true;
+}
+
+void harness_trace_stop(void)
+{
+    ll_trace_stop();
+    if(trace_file != NULL)
+    {
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+}
+
+bool harness_set_integrity(uint32_t integrity_id)
+{
+    const flash_integrity_t* integrity = flash_integrity_builtin(integrity_id);
+    if(integrity == NULL)
+    {
+        return false;
+    }
+
+    flash_config.integrity = integrity;
+    return true;
+}
+
+/*
+    Encapsulate flash initialization
+    status console output
+*/
+static flash_status_t _flash_init(flash_config_t* flash_config)
+{
+    // Initialize flash driver with our apps configuration
+    flash_status_t status = flash_init(flash_config);
+
+    if(!verbose)
+    {
+        return status;
+    }
+
+    switch(status)
+    {
+        case flash_status_ok:
+            printf("main:init: flash good!\n");
+            break;
+
+        case flash_status_total_size_exceeded:
+            printf("main:init: requested app data layout exceeds available flash\n");
+            break;
+
+        case flash_status_invalid_config:
+            printf("main:init: invalid configuration (copy count, banks or copy layout)\n");
+            break;
+
+        case flash_status_data_corruption_detected:
+            printf("main:init: data corruption detected\n");
+            break;
+
+        case flash_status_no_valid_data_found:
+            printf("main:init: no valid data found\n");
+            break;
+
+        case flash_status_crc_check_failure:
+            printf("main:init: crc check failure - corrupted data");
+            break;
+
+        case flash_status_ll_init_fault:
+            printf("main:init: ll stub reported issue - OK if nv_data didn't exist on first run\n");
+            break;
+
+        default:
+            printf("main:init: unexpected state!\n");
+            assert(0);
+            break;
+    }
+
+    return status;
+}
+
+/*
+    Encapsulate flash write
+    status console output
+*/
+static flash_status_t _flash_write(void)
+{
+    flash_status_t status = flash_write();
+
+    if(!verbose)
+    {
+        return status;
+    }
+
+    switch(status)
+    {
+        case flash_status_ok:
+            printf("main: write good!\n");
+            break;
+
+        default:
+            printf("main: write fail: %d\n", status);
+            break;
+    }
+
+    return status;
+}
@@ -1,33 +1,249 @@
 import subprocess
 from enum import Enum
+import argparse
+import ctypes
 import os
+import random
+import re
+import struct
+import zlib
 
 ROOT_DIR = os.path.abspath(os.path.join(os.path.dirname(__file__), ".."))
 BIN_PATH = os.path.join(ROOT_DIR, "build/c_project")
+LIB_PATH = os.environ.get("FLASH_HARNESS_LIB", os.path.join(ROOT_DIR, "build/harness_lib/libflash_harness.so"))
 
 class CMD(Enum):
     INIT = 0
     WRITE = 1
     UPDATE_DATA = 2
     INIT_TEST_DATA = 3
-    
-tests = [[CMD.INIT_TEST_DATA, CMD.INIT, CMD.WRITE]]
 
-if __name__ == "__main__":
+tests = [[CMD.INIT_TEST_DATA, CMD.INIT, CMD.WRITE],
+         [CMD.INIT, CMD.UPDATE_DATA, CMD.WRITE, CMD.INIT]]
 
-    def parse_cfg_symbols(filename):
-        cfg_dict = {}
-        with open(f'../{filename}', 'r') as f:
-            for line in f:
-                line = line.strip()
-                if line.startswith('#define CFG_'):
-                    parts = line.split(None, 3)
-                    if len(parts) == 3:
-                        key, value = parts[1:]
-                        cfg_dict[key] = value
-        return cfg_dict
+# UPDATE_DATA reads its contents from here when nothing is staged (subprocess runs)
+APP_DATA_UPDATE_PATH = os.path.join(ROOT_DIR, "app_data_update")
+APP_DATA_UPDATE_NUM_BYTES = 4096
 
-    cfg_symbols = parse_cfg_symbols('flash_conf.h')
+FLASH_STATUS_OK = 0
+FLASH_STATUS_NO_VALID_DATA_FOUND = 3
+FLASH_STATUS_DATA_CORRUPTION_DETECTED = 4
+
+# Copies written before versioning: validity, length and CRC32 of the app data which follows
+CFG_APP_DATA_VALID = 0x55555555
+CFG_APP_DATA_INVALID = 0x00000000
+BASELINE_META_NUM_BYTES = 12
+
+# flash_health_t
+HEALTH_UNCHECKED = 0
+HEALTH_OK = 1
+HEALTH_CORRUPT = 2
+
+# flash_integrity.h built-in ids
+INTEGRITY_CRC32 = 1
+INTEGRITY_CRC32C = 2
+INTEGRITY_XXH64 = 3
+
+
+class FlashVersionInfo(ctypes.Structure):
+    _fields_ = [('copy_idx', ctypes.c_uint32),
+                ('version', ctypes.c_uint32),
+                ('activation', ctypes.c_uint32),
+                ('length', ctypes.c_uint32),
+                ('integrity_id', ctypes.c_uint32),
+                ('bank', ctypes.c_uint32),
+                ('crc_ok', ctypes.c_bool),
+                ('active', ctypes.c_bool)]
+
+
+class FlashScrubStats(ctypes.Structure):
+    _fields_ = [('passes', ctypes.c_uint32),
+                ('copies_checked', ctypes.c_uint32),
+                ('copies_corrupt', ctypes.c_uint32),
+                ('bytes_read', ctypes.c_uint64)]
+
+
+class InProcessHarness:
+    """Drives the opcode dispatcher via libflash_harness.so, no process or file IO per op."""
+
+    def __init__(self, lib_path):
+        self.lib = ctypes.CDLL(lib_path)
+        self.lib.harness_reset.argtypes = [ctypes.c_bool]
+        self.lib.harness_set_verbose.argtypes = [ctypes.c_bool]
+        self.lib.harness_dispatch.argtypes = [ctypes.c_uint32]
+        self.lib.harness_dispatch.restype = ctypes.c_int32
+        self.lib.harness_run.argtypes = [ctypes.POINTER(ctypes.c_uint32), ctypes.c_uint32]
+        self.lib.harness_run.restype = ctypes.c_uint32
+        self.lib.harness_stage_app_data.argtypes = [ctypes.c_char_p, ctypes.c_uint32]
+        self.lib.harness_stage_app_data.restype = ctypes.c_bool
+        self.lib.harness_app_data.restype = ctypes.POINTER(ctypes.c_uint8)
+        self.lib.harness_app_data_len.restype = ctypes.c_uint32
+        self.lib.harness_flash_read.argtypes = [ctypes.c_uint32, ctypes.c_char_p, ctypes.c_uint32]
+        self.lib.harness_flash_read.restype = ctypes.c_bool
+
+        self.lib.flash_versions.argtypes = [ctypes.POINTER(FlashVersionInfo), ctypes.c_uint32,
+                                            ctypes.POINTER(ctypes.c_uint32)]
+        self.lib.flash_read_version.argtypes = [ctypes.c_uint32, ctypes.c_uint32, ctypes.c_char_p, ctypes.c_uint32]
+        self.lib.flash_rollback.argtypes = [ctypes.c_uint32]
+        self.lib.harness_trace_start.argtypes = [ctypes.c_char_p, ctypes.c_bool]
+        self.lib.harness_trace_start.restype = ctypes.c_bool
+        self.lib.harness_set_integrity.argtypes = [ctypes.c_uint32]
+        self.lib.harness_set_integrity.restype = ctypes.c_bool
+        self.lib.harness_flash_corrupt.argtypes = [ctypes.c_uint32, ctypes.c_uint8]
+        self.lib.harness_flash_corrupt.restype = ctypes.c_bool
+        self.lib.harness_flash_poke.argtypes = [ctypes.c_uint32, ctypes.c_char_p, ctypes.c_uint32]
+        self.lib.harness_flash_poke.restype = ctypes.c_bool
+        self.lib.harness_meta_num_bytes.restype = ctypes.c_uint32
+        self.lib.harness_version_addr.argtypes = [ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint32)]
+        self.lib.harness_version_addr.restype = ctypes.c_bool
+        self.lib.flash_scrub_step.argtypes = [ctypes.c_uint32]
+        self.lib.flash_version_health.argtypes = [ctypes.c_uint32, ctypes.POINTER(ctypes.c_int)]
+        self.lib.flash_scrub_stats.argtypes = [ctypes.POINTER(FlashScrubStats)]
+
+        self.lib.harness_set_verbose(False)
+        self.lib.harness_reset(False)
+        self.app_data_len = self.lib.harness_app_data_len()
+        self.meta_num_bytes = self.lib.harness_meta_num_bytes()
+
+    def run(self, ops):
+        arr = (ctypes.c_uint32 * len(ops))(*[op.value for op in ops])
+        return self.lib.harness_run(arr, len(ops))
+
+    def dispatch(self, op):
+        return self.lib.harness_dispatch(op.value)
+
+    def stage(self, data):
+        return self.lib.harness_stage_app_data(bytes(data), len(data))
+
+    def app_data(self):
+        return ctypes.string_at(self.lib.harness_app_data(), self.app_data_len)
+
+    def flash_read(self, addr, num_bytes):
+        buf = ctypes.create_string_buffer(num_bytes)
+        if not self.lib.harness_flash_read(addr, buf, num_bytes):
+            raise RuntimeError(f'flash read failed at {addr:#x}')
+        return buf.raw
+
+    def versions(self, max_versions=16):
+        info = (FlashVersionInfo * max_versions)()
+        num = ctypes.c_uint32(0)
+        if self.lib.flash_versions(info, max_versions, ctypes.byref(num)) != FLASH_STATUS_OK:
+            raise RuntimeError('flash_versions failed')
+        return list(info[:num.value])
+
+    def read_version(self, version, offset, num_bytes):
+        buf = ctypes.create_string_buffer(num_bytes)
+        status = self.lib.flash_read_version(version, offset, buf, num_bytes)
+        return status, buf.raw
+
+    def rollback(self, version):
+        return self.lib.flash_rollback(version)
+
+    def trace_start(self, path, hash_payloads=False):
+        if not self.lib.harness_trace_start(path.encode(), hash_payloads):
+            raise RuntimeError(f'could not open trace file {path}')
+
+    def trace_stop(self):
+        self.lib.harness_trace_stop()
+
+    def set_integrity(self, integrity_id):
+        if not self.lib.harness_set_integrity(integrity_id):
+            raise RuntimeError(f'unknown integrity algorithm {integrity_id}')
+
+    def corrupt(self, addr, xor_mask):
+        if not self.lib.harness_flash_corrupt(addr, xor_mask):
+            raise RuntimeError(f'could not corrupt flash at {addr:#x}')
+
+    def poke(self, addr, data):
+        if not self.lib.harness_flash_poke(addr, bytes(data), len(data)):
+            raise RuntimeError(f'could not write flash at {addr:#x}')
+
+    def version_addr(self, version):
+        addr = ctypes.c_uint32(0)
+        if not self.lib.harness_version_addr(version, ctypes.byref(addr)):
+            raise RuntimeError(f'no copy holds version {version}')
+        return addr.value
+
+    def scrub_step(self, budget_bytes):
+        return self.lib.flash_scrub_step(budget_bytes)
+
+    def health(self, version):
+        health = ctypes.c_int(0)
+        if self.lib.flash_version_health(version, ctypes.byref(health)) != FLASH_STATUS_OK:
+            raise RuntimeError(f'version {version} not retained')
+        return health.value
+
+    def scrub_stats(self):
+        stats = FlashScrubStats()
+        self.lib.flash_scrub_stats(ctypes.byref(stats))
+        return stats
+
+
+def run_history_check(harness, rng):
+    """Commits a few versions, reads each back by version, rolls back to the oldest and power cycles."""
+    failures = 0
+    payloads = {}
+
+    for _ in range(3):
+        harness.stage(rng.randbytes(harness.app_data_len))
+        harness.dispatch(CMD.UPDATE_DATA)
+        harness.dispatch(CMD.WRITE)
+        newest = max(v.version for v in harness.versions())
+        payloads[newest] = harness.app_data()
+
+    versions = harness.versions()
+    if [v.version for v in versions] != sorted(payloads, reverse=True) or not versions[0].active:
+        failures += 1
+        print(f'ERROR: history: unexpected version list {[(v.version, v.active) for v in versions]}')
+
+    for version, payload in payloads.items():
+        status, data = harness.read_version(version, 0, len(payload))
+        if status != FLASH_STATUS_OK or data != payload:
+            failures += 1
+            print(f'ERROR: history: version {version} read back mismatch (status {status})')
+
+    oldest = min(payloads)
+    status = harness.rollback(oldest)
+    harness.dispatch(CMD.INIT)
+    if status != FLASH_STATUS_OK or harness.app_data() != payloads[oldest]:
+        failures += 1
+        print(f'ERROR: history: rollback to version {oldest} not recovered (status {status})')
+
+    print(f'history check: {len(payloads)} versions, {failures} failure(s)')
+    return failures
+
+
+def run_integrity_check(harness, rng):
+    """Commits under each integrity algorithm in turn, every retained version must still verify."""
+    failures = 0
+    payloads = {}
+
+    for integrity_id in (INTEGRITY_CRC32C, INTEGRITY_XXH64, INTEGRITY_CRC32):
+        harness.set_integrity(integrity_id)
+        harness.dispatch(CMD.INIT)
+        harness.stage(rng.randbytes(harness.app_data_len))
+        harness.dispatch(CMD.UPDATE_DATA)
+        harness.dispatch(CMD.WRITE)
+        newest = max(v.version for v in harness.versions())
+        payloads[newest] = (integrity_id, harness.app_data())
+
+    harness.dispatch(CMD.INIT)
+    for info in harness.versions():
+        if info.version not in payloads:
+            continue
+        integrity_id, payload = payloads[info.version]
+        status, data = harness.read_version(info.version, 0, len(payload))
+        if info.integrity_id != integrity_id or not info.crc_ok or status != FLASH_STATUS_OK or data != payload:
+            failures += 1
+            print(f'ERROR: integrity: version {info.version} (algorithm {info.integrity_id}) did not verify')
+
+    print(f'integrity check: {len(payloads)} algorithms, {failures} failure(s)')
+    return failures
+
+
+def run_subprocess(tests, seed):
+    rng = random.Random(seed)
+    failures = 0
 
     for test_idx, test in enumerate(tests):
 
@@ -35,6 +251,11 @@ if __name__ == "__main__":
 
             print('running..')
 
+            # The process picks the update up from file, one payload per test
+            if CMD.UPDATE_DATA in test:
+                with open(APP_DATA_UPDATE_PATH, 'wb') as f:
+                    f.write(rng.randbytes(APP_DATA_UPDATE_NUM_BYTES))
+
             args = [str(len(test))] + [str(op.value) for op in test]
             #print(args)
 
@@ -47,7 +268,234 @@ if __name__ == "__main__":
             )
 
             print(result.stdout)
+            if 'update failed' in result.stdout:
+                failures += 1
+                print(f'ERROR: test {test_idx}: app data update not applied')
 
         except subprocess.CalledProcessError as e:
+            failures += 1
             print(f'ERROR: Exception occured during test {test_idx}')
             print(f'ERROR: Exception details: {e}')
+
+        finally:
+            if os.path.exists(APP_DATA_UPDATE_PATH):
+                os.remove(APP_DATA_UPDATE_PATH)
+
+    return failures
+
+
+def run_scrub_check(harness, rng, budget_bytes=4096):
+    """Rots a byte of an inactive version, the scrubber must find it within bounded steps and see it heal."""
+    failures = 0
+
+    for _ in range(3):
+        harness.stage(rng.randbytes(harness.app_data_len))
+        harness.dispatch(CMD.UPDATE_DATA)
+        harness.dispatch(CMD.WRITE)
+    harness.dispatch(CMD.INIT)
+
+    versions = harness.versions()
+    active = next(v.version for v in versions if v.active)
+    inactive = [v.version for v in versions if not v.active]
+    victim = min(inactive)
+    if any(harness.health(v) != HEALTH_UNCHECKED for v in inactive) or harness.health(active) != HEALTH_OK:
+        failures += 1
+        print('ERROR: scrub: init should verify the active version only')
+
+    rot_addr = harness.version_addr(victim) + harness.meta_num_bytes + rng.randrange(harness.app_data_len)
+
+    def scrub_passes(num_passes):
+        found = False
+        start = harness.scrub_stats()
+        while harness.scrub_stats().passes < start.passes + num_passes:
+            bytes_before = harness.scrub_stats().bytes_read
+            found |= harness.scrub_step(budget_bytes) == FLASH_STATUS_DATA_CORRUPTION_DETECTED
+            if harness.scrub_stats().bytes_read - bytes_before > budget_bytes + harness.meta_num_bytes:
+                raise RuntimeError('scrub step overran its budget')
+        return found
+
+    harness.corrupt(rot_addr, 0x10)
+    found = scrub_passes(1)
+    if not found or harness.health(victim) != HEALTH_CORRUPT or \
+            any(harness.health(v) != HEALTH_OK for v in inactive if v != victim):
+        failures += 1
+        print(f'ERROR: scrub: rotted version {victim} not reported ({[(v, harness.health(v)) for v in inactive]})')
+    if harness.rollback(victim) == FLASH_STATUS_OK:
+        failures += 1
+        print(f'ERROR: scrub: rollback to rotted version {victim} succeeded')
+
+    harness.corrupt(rot_addr, 0x10)
+    if scrub_passes(1) or harness.health(victim) != HEALTH_OK:
+        failures += 1
+        print(f'ERROR: scrub: restored version {victim} still reported corrupt')
+
+    stats = harness.scrub_stats()
+    print(f'scrub check: {stats.passes} passes, {stats.copies_checked} copies checked, {failures} failure(s)')
+    return failures
+
+
+def cfg_pages(cfg_symbols):
+    """(base address, size) of each page described in flash_conf.h."""
+    pages = []
+    for page_num in range(1, int(cfg_symbols['CFG_NUM_PAGES']) + 1):
+        size = cfg_symbols[f'CFG_PAGE{page_num}_NUM_BYTES']
+        kb = re.fullmatch(r'NUM_KB_TO_NUM_BYTE\((\d+)\)', size)
+        pages.append((int(cfg_symbols[f'CFG_PAGE{page_num}_BASE_ADDR'], 0), int(kb.group(1)) * 1024 if kb else int(size, 0)))
+    return pages
+
+
+def baseline_copy_addrs(pages, num_copies, app_data_len):
+    """Copy bases of firmware before versioning, its walk counts the app data only and can overlap copies."""
+    addrs = [pages[0][0]]
+    page_idx, bytes_traversed = 0, 0
+    while len(addrs) < num_copies and page_idx < len(pages):
+        if pages[page_idx][1] + bytes_traversed >= app_data_len:
+            addrs.append(pages[page_idx][0])
+            bytes_traversed = 0
+        else:
+            bytes_traversed += pages[page_idx][1]
+            page_idx += 1
+    return addrs
+
+
+def baseline_copy(validity, payload):
+    return struct.pack('<III', validity, len(payload), zlib.crc32(payload)) + payload
+
+
+def run_baseline_check(harness, rng, pages, num_copies):
+    """Lays down images written before versioning, init must load and commit them as version 1."""
+    failures = 0
+
+    def erase_all():
+        for base_addr, num_bytes in pages:
+            harness.poke(base_addr, b'\xff' * num_bytes)
+
+    bases = baseline_copy_addrs(pages, num_copies, harness.app_data_len)
+    for active_addr in bases:
+        erase_all()
+        stale = rng.randbytes(harness.app_data_len)
+        payload = rng.randbytes(harness.app_data_len)
+        for base_addr in bases:
+            if base_addr != active_addr:
+                harness.poke(base_addr, baseline_copy(CFG_APP_DATA_INVALID, stale))
+        harness.poke(active_addr, baseline_copy(CFG_APP_DATA_VALID, payload))
+
+        # Power cycle straight after the migration too, it must not run twice
+        for boot in range(2):
+            status = harness.dispatch(CMD.INIT)
+            versions = harness.versions()
+            if status != FLASH_STATUS_OK or harness.app_data() != payload or [v.version for v in versions] != [1] or \
+                    not versions[0].crc_ok or versions[0].integrity_id != INTEGRITY_CRC32:
+                failures += 1
+                print(f'ERROR: baseline {active_addr:#x}: boot {boot} not loaded (status {status}, {versions})')
+                break
+
+        # The commit must not have erased the copy it was made from
+        migrated_addr = harness.version_addr(1)
+        old_end = active_addr + BASELINE_META_NUM_BYTES + harness.app_data_len
+        if migrated_addr < old_end and active_addr < migrated_addr + harness.meta_num_bytes + harness.app_data_len:
+            failures += 1
+            print(f'ERROR: baseline {active_addr:#x}: migrated over itself to {migrated_addr:#x}')
+
+        payloads = {1: payload}
+        for _ in range(2):
+            harness.stage(rng.randbytes(harness.app_data_len))
+            harness.dispatch(CMD.UPDATE_DATA)
+            harness.dispatch(CMD.WRITE)
+            payloads[max(v.version for v in harness.versions())] = harness.app_data()
+        harness.dispatch(CMD.INIT)
+        if harness.app_data() != payloads[3] or \
+                any(harness.read_version(v, 0, harness.app_data_len)[1] != payloads[v] for v in payloads):
+            failures += 1
+            print(f'ERROR: baseline {active_addr:#x}: history after migration broken')
+
+    # A bad CRC is not carried over
+    erase_all()
+    image = bytearray(baseline_copy(CFG_APP_DATA_VALID, rng.randbytes(harness.app_data_len)))
+    image[-1] ^= 0x01
+    harness.poke(bases[0], image)
+    status = harness.dispatch(CMD.INIT)
+    if status != FLASH_STATUS_NO_VALID_DATA_FOUND or harness.versions():
+        failures += 1
+        print(f'ERROR: baseline: corrupt copy accepted (status {status})')
+
+    print(f'baseline check: {len(bases)} images, {failures} failure(s)')
+    return failures
+
+
+def run_in_process(tests, num_random_ops, seed, pages, num_copies, trace_path=None):
+    harness = InProcessHarness(LIB_PATH)
+    if trace_path:
+        harness.trace_start(trace_path)
+
+    rng = random.Random(seed)
+    for test_idx, test in enumerate(tests):
+        if CMD.UPDATE_DATA in test:
+            harness.stage(rng.randbytes(APP_DATA_UPDATE_NUM_BYTES))
+        num_failed = harness.run(test)
+        print(f'test {test_idx}: {num_failed} op(s) did not return ok')
+
+    # Randomised campaign: update, commit and power cycle, the data
+    # recovered by INIT must always match the last committed data
+    rng = random.Random(seed)
+    harness.run([CMD.INIT_TEST_DATA, CMD.INIT, CMD.WRITE])
+    committed = harness.app_data()
+    failures = 0
+
+    for op_idx in range(num_random_ops):
+        op = rng.choice([CMD.UPDATE_DATA, CMD.WRITE, CMD.INIT])
+
+        if op == CMD.UPDATE_DATA:
+            harness.stage(rng.randbytes(rng.randint(1, harness.app_data_len)))
+            harness.dispatch(op)
+        elif op == CMD.WRITE:
+            if harness.dispatch(op) == FLASH_STATUS_OK:
+                committed = harness.app_data()
+        else:
+            status = harness.dispatch(op)
+            if status != FLASH_STATUS_OK or harness.app_data() != committed:
+                failures += 1
+                print(f'ERROR: op {op_idx}: recovered data mismatch (init status {status})')
+            committed = harness.app_data()
+
+    print(f'random campaign: {num_random_ops} ops, {failures} failure(s)')
+    failures += run_history_check(harness, rng)
+    failures += run_integrity_check(harness, rng)
+    failures += run_scrub_check(harness, rng)
+    failures += run_baseline_check(harness, rng, pages, num_copies)
+
+    harness.trace_stop()
+    return failures
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--in-process', action='store_true',
+                        help='drive libflash_harness.so via ctypes instead of one process per test')
+    parser.add_argument('--random-ops', type=int, default=1000,
+                        help='number of randomised ops (in-process only)')
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('--trace', metavar='FILE',
+                        help='record the ll_flash ops of the run (in-process only), see tools/trace_replay')
+    cli_args = parser.parse_args()
+
+    def parse_cfg_symbols(filename):
+        cfg_dict = {}
+        with open(os.path.join(ROOT_DIR, filename), 'r') as f:
+            for line in f:
+                line = line.strip()
+                if line.startswith('#define CFG_'):
+                    parts = line.split(None, 3)
+                    if len(parts) == 3:
+                        key, value = parts[1:]
+                        cfg_dict[key] = value
+        return cfg_dict
+
+    cfg_symbols = parse_cfg_symbols('flash_conf.h')
+
+    if cli_args.in_process:
+        exit(1 if run_in_process(tests, cli_args.random_ops, cli_args.seed, cfg_pages(cfg_symbols),
+                                 int(cfg_symbols['CFG_APP_DATA_NUM_COPIES']), cli_args.trace) else 0)
+    else:
+        exit(1 if run_subprocess(tests, cli_args.seed) else 0)
@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "flash.h"
+#include "flash_conf.h"
+#include "flash_integrity.h"
+#include "ll_flash_stub.h"
+
+/*
+Endurance simulation, projects field lifetime of a flash layout.
+
+Drives flash_write in a tight loop against the in-memory stub (persistence
+off), each commit changing the app data, with an optional reboot (flash_init)
+every N commits. The stub counts erases and programs per page, from which the
+hottest page gives the projected commits to first page wearout for a rated
+erase endurance, and the lifetime at a given commit rate. The erase count
+distribution over all pages shows how evenly the copies spread the wear.
+
+Geometry is uniform pages, optionally grouped into sectors which are then
+erased in one op (wearing every page of the sector).
+
+With -B the pages are split into that many equal read-while-write banks, the
+stub models bank busy time and a concurrent reader (think ISR or second task)
+reads the active version ahead of every erase / program op of each commit.
+Reads which had to wait for a busy bank are reported, with the copies spread
+over two or more banks there should be none. The copy count must split evenly
+over the banks (flash_init refuses an uneven share).
+
+usage: endurance_sim [-d app_data_bytes] [-n copies] [-p pages] [-s page_bytes]
+                     [-S pages_per_sector] [-c commits] [-E rated_erase_cycles]
+                     [-r commits_per_day] [-a crc32|crc32c|xxh64] [-b reboot_every]
+                     [-B banks] [-N] [-o wear.csv]
+*/
+
+#define HISTOGRAM_BINS   10
+#define HISTOGRAM_WIDTH  40
+#define DEVICE_BASE_ADDR 0x08000000UL
+
+// Bank model timing, roughly a 4 ms page erase against 20 us per programmed word
+#define BANK_ERASE_TICKS_PER_PAGE   200
+#define BANK_PROGRAM_TICKS_PER_WORD 1
+#define READER_NUM_BYTES            16
+
+static struct {
+    uint32_t app_data_num_bytes;
+    uint32_t num_copies;
+    uint32_t num_pages;
+    uint32_t page_num_bytes;
+    uint32_t pages_per_sector;
+    uint64_t num_commits;
+    uint64_t rated_erase_cycles;
+    double   commits_per_day;
+    uint32_t reboot_every;
+    uint32_t num_banks;     // 0: no bank model
+    bool     nor;
+    const char* csv_path;
+    const flash_integrity_t* integrity;
+
+    page_dsc_t*   pages;
+    sector_dsc_t* sectors;
+    uint32_t      num_sectors;
+    uint8_t*      app_data;
+    flash_config_t config;
+
+    ll_flash_stub_page_wear_t* wear;
+
+    // Concurrent reader, active_version is 0 until the first commit
+    uint32_t active_version;
+    uint64_t reader_reads;
+    uint64_t reader_stalls;
+    uint64_t reader_stall_ticks;
+} sim;
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Runs ahead of each program / erase op, reads the head of the active version as a
+// task sharing the part with the commit would
+static void reader_hook(ll_flash_stub_op_t op, uint32_t addr, uint32_t num_bytes)
+{
+    (void)op;
+    (void)addr;
+    (void)num_bytes;
+
+    if(sim.active_version == 0)
+    {
+        return;
+    }
+
+    uint8_t data[READER_NUM_BYTES];
+    uint32_t num_read = (sim.app_data_num_bytes < READER_NUM_BYTES) ? sim.app_data_num_bytes : READER_NUM_BYTES;
+    uint64_t start = ll_flash_stub_now();
+
+    ++sim.reader_reads;
+    flash_read_version(sim.active_version, 0, data, num_read);
+    if(ll_flash_stub_now() != start)
+    {
+        ++sim.reader_stalls;
+        sim.reader_stall_ticks += ll_flash_stub_now() - start;
+    }
+}
+
+static bool setup(void)
+{
+    sim.pages = calloc(sim.num_pages, sizeof(page_dsc_t));
+    sim.app_data = malloc(sim.app_data_num_bytes);
+    sim.wear = calloc(sim.num_pages, sizeof(ll_flash_stub_page_wear_t));
+    if((sim.pages == NULL) || (sim.app_data == NULL) || (sim.wear == NULL))
+    {
+        return false;
+    }
+
+    for(uint32_t page_idx = 0; page_idx < sim.num_pages; ++page_idx)
+    {
+        sim.pages[page_idx].base_addr  = DEVICE_BASE_ADDR + page_idx * sim.page_num_bytes;
+        sim.pages[page_idx].size_bytes = sim.page_num_bytes;
+        sim.pages[page_idx].bank       = (sim.num_banks > 1) ? (uint32_t)(((uint64_t)page_idx * sim.num_banks) / sim.num_pages) : 0;
+    }
+
+    if(sim.pages_per_sector > 1)
+    {
+        sim.num_sectors = sim.num_pages / sim.pages_per_sector;
+        sim.sectors = calloc(sim.num_sectors, sizeof(sector_dsc_t));
+        if(sim.sectors == NULL)
+        {
+            return false;
+        }
+        for(uint32_t sector_idx = 0; sector_idx < sim.num_sectors; ++sector_idx)
+        {
+            sim.sectors[sector_idx].first_page_idx = sector_idx * sim.pages_per_sector;
+            sim.sectors[sector_idx].num_pages      = sim.pages_per_sector;
+        }
+    }
+
+    for(uint32_t idx = 0; idx < sim.app_data_num_bytes; ++idx)
+    {
+        sim.app_data[idx] = (uint8_t)(idx + 1);
+    }
+
+    sim.config.num_app_data_copies              = sim.num_copies;
+    sim.config.num_banks                        = sim.num_banks;
+    sim.config.data_descriptor.app_data         = sim.app_data;
+    sim.config.data_descriptor.data_num_bytes   = sim.app_data_num_bytes;
+    sim.config.integrity                        = sim.integrity;
+    sim.config.ll.write_granularity             = write_size_32bit;
+    sim.config.ll.pages_total_num               = sim.num_pages;
+    sim.config.ll.page_descriptors              = sim.pages;
+    sim.config.ll.sectors_total_num             = sim.num_sectors;
+    sim.config.ll.sector_descriptors            = sim.sectors;
+
+    ll_flash_stub_set_persistence(false);
+    const ll_flash_stub_program_mode_t mode = { .nor = sim.nor, .once_per_word = sim.nor, .strict = sim.nor };
+    ll_flash_stub_set_program_mode(&mode);
+
+    if(sim.num_banks > 0)
+    {
+        const ll_flash_stub_bank_timing_t timing = {
+            .erase_ticks_per_page   = BANK_ERASE_TICKS_PER_PAGE,
+            .program_ticks_per_word = BANK_PROGRAM_TICKS_PER_WORD,
+        };
+        ll_flash_stub_set_bank_timing(&timing);
+        ll_flash_stub_set_op_hook(reader_hook);
+    }
+    return true;
+}
+
+static flash_status_t boot(void)
+{
+    flash_deinit();
+    flash_status_t status = flash_init(&sim.config);
+    return (status == flash_status_no_valid_data_found) ? flash_status_ok : status;
+}
+
+static bool run(void)
+{
+    flash_status_t status = boot();
+    if(status != flash_status_ok)
+    {
+        printf("endurance_sim: flash_init failed (status %d), layout does not fit?\n", status);
+        return false;
+    }
+    ll_flash_stub_clear_wear();
+    ll_flash_stub_clear_bank_stats();
+
+    for(uint64_t commit = 0; commit < sim.num_commits; ++commit)
+    {
+        // New content every commit, a counter in the first word
+        uint32_t counter = (uint32_t)commit;
+        memcpy(sim.app_data, &counter, (sim.app_data_num_bytes < sizeof(counter)) ? sim.app_data_num_bytes : sizeof(counter));
+
+        status = flash_write();
+        if(status != flash_status_ok)
+        {
+            printf("endurance_sim: commit %llu failed (status %d)\n", (unsigned long long)commit, status);
+            return false;
+        }
+        sim.active_version = (uint32_t)(commit + 1); // Fresh device, versions count commits
+
+        if((sim.reboot_every > 0) && (((commit + 1) % sim.reboot_every) == 0))
+        {
+            status = boot();
+            if(status != flash_status_ok)
+            {
+                printf("endurance_sim: reboot after commit %llu failed (status %d)\n", (unsigned long long)commit, status);
+                return false;
+            }
+        }
+    }
+
+    for(uint32_t page_idx = 0; page_idx < sim.num_pages; ++page_idx)
+    {
+        ll_flash_stub_page_wear(page_idx, &sim.wear[page_idx]);
+    }
+    return true;
+}
+
+static void report_histogram(uint64_t min_erases, uint64_t max_erases)
+{
+    uint32_t bins[HISTOGRAM_BINS] = { 0 };
+    uint64_t span = max_erases - min_erases + 1;
+    uint32_t num_bins = (span < HISTOGRAM_BINS) ? (uint32_t)span : HISTOGRAM_BINS;
+    uint32_t max_bin = 0;
+
+    for(uint32_t page_idx = 0; page_idx < sim.num_pages; ++page_idx)
+    {
+        uint32_t bin = (uint32_t)(((sim.wear[page_idx].erase_count - min_erases) * num_bins) / span);
+        if(++bins[bin] > max_bin)
+        {
+            max_bin = bins[bin];
+        }
+    }
+
+    printf("\nerase count distribution (pages per bin)\n");
+    for(uint32_t bin = 0; bin < num_bins; ++bin)
+    {
+        uint64_t lo = min_erases + (span * bin) / num_bins;
+        uint64_t hi = min_erases + (span * (bin + 1)) / num_bins - 1;
+        uint32_t bar = (uint32_t)(((uint64_t)bins[bin] * HISTOGRAM_WIDTH + max_bin - 1) / max_bin);
+
+        printf("  %10llu - %-10llu %6u |", (unsigned long long)lo, (unsigned long long)hi, bins[bin]);
+        for(uint32_t idx = 0; idx < bar; ++idx)
+        {
+            putchar('#');
+        }
+        putchar('\n');
+    }
+}
+
+static void report(double elapsed_s)
+{
+    uint64_t min_erases = UINT64_MAX, max_erases = 0, total_erases = 0, total_programmed = 0;
+    uint32_t hottest_page = 0;
+
+    for(uint32_t page_idx = 0; page_idx < sim.num_pages; ++page_idx)
+    {
+        const ll_flash_stub_page_wear_t* wear = &sim.wear[page_idx];
+        if(wear->erase_count > max_erases)
+        {
+            max_erases   = wear->erase_count;
+            hottest_page = page_idx;
+        }
+        if(wear->erase_count < min_erases)
+        {
+            min_erases = wear->erase_count;
+        }
+        total_erases     += wear->erase_count;
+        total_programmed += wear->bytes_programmed;
+    }
+
+    double commits_per_s = (double)sim.num_commits / elapsed_s;
+    printf("endurance_sim: %llu commits of %u B app data, %u copies over %u x %u B pages",
+           (unsigned long long)sim.num_commits, sim.app_data_num_bytes, sim.num_copies, sim.num_pages, sim.page_num_bytes);
+    if(sim.num_sectors > 0)
+    {
+        printf(" (%u page sectors)", sim.pages_per_sector);
+    }
+    if(sim.num_banks > 0)
+    {
+        printf(" in %u bank%s", sim.num_banks, (sim.num_banks > 1) ? "s" : "");
+    }
+    printf(", %s%s\n", sim.integrity->name, sim.nor ? ", strict NOR" : "");
+    printf("endurance_sim: %.2f s, %.0f commits/s (%.1fM commits/min)\n",
+           elapsed_s, commits_per_s, commits_per_s * 60.0 / 1e6);
+    printf("endurance_sim: %.3f page erases and %.0f bytes programmed per commit, mean page %.1f / hottest %.0f erases\n",
+           (double)total_erases / (double)sim.num_commits, (double)total_programmed / (double)sim.num_commits,
+           (double)total_erases / sim.num_pages, (double)max_erases);
+
+    report_histogram(min_erases, max_erases);
+
+    if(sim.num_banks > 0)
+    {
+        printf("\nread-while-write (erase %u, program %u ticks per page / word)\n",
+               BANK_ERASE_TICKS_PER_PAGE, BANK_PROGRAM_TICKS_PER_WORD);
+        for(uint32_t bank = 0; bank < sim.num_banks; ++bank)
+        {
+            ll_flash_stub_bank_stats_t stats;
+            ll_flash_stub_bank_stats(bank, &stats);
+            printf("  bank %u: %llu ops, %llu ticks busy, %llu reads stalled (%llu ticks)\n", bank,
+                   (unsigned long long)stats.ops, (unsigned long long)stats.busy_ticks,
+                   (unsigned long long)stats.reads_stalled, (unsigned long long)stats.stall_ticks);
+        }
+        printf("  concurrent reads of the active version: %llu, %llu stalled (%llu ticks)\n",
+               (unsigned long long)sim.reader_reads, (unsigned long long)sim.reader_stalls,
+               (unsigned long long)sim.reader_stall_ticks);
+    }
+
+    printf("\nprojection (rated %llu erase cycles per page)\n", (unsigned long long)sim.rated_erase_cycles);
+    if(max_erases == 0)
+    {
+        printf("  no page was erased, nothing to project\n");
+        return;
+    }
+
+    // The commit ring is periodic, wear grows linearly with commits
+    double commits_to_wearout = (double)sim.rated_erase_cycles * (double)sim.num_commits / (double)max_erases;
+    double ideal = (double)sim.rated_erase_cycles * (double)sim.num_commits * sim.num_pages / (double)total_erases;
+    printf("  first page to wear out: page %u after %.3g commits\n", hottest_page, commits_to_wearout);
+    printf("  perfectly levelled wear over every page would allow %.3g commits (%.0f%% reached)\n",
+           ideal, 100.0 * commits_to_wearout / ideal);
+    printf("  at %.0f commits/day: %.1f years\n", sim.commits_per_day, commits_to_wearout / sim.commits_per_day / 365.25);
+}
+
+static bool write_csv(void)
+{
+    FILE* file = fopen(sim.csv_path, "w");
+    if(file == NULL)
+    {
+        return false;
+    }
+
+    fprintf(file, "page,base_addr,erase_count,program_ops,bytes_programmed\n");
+    for(uint32_t page_idx = 0; page_idx < sim.num_pages; ++page_idx)
+    {
+        fprintf(file, "%u,0x%08x,%llu,%llu,%llu\n", page_idx, sim.pages[page_idx].base_addr,
+                (unsigned long long)sim.wear[page_idx].erase_count,
+                (unsigned long long)sim.wear[page_idx].program_ops,
+                (unsigned long long)sim.wear[page_idx].bytes_programmed);
+    }
+    fclose(file);
+    return true;
+}
+
+#define USAGE "usage: %s [-d app_data_bytes] [-n copies] [-p pages] [-s page_bytes] [-S pages_per_sector]\n" \
+              "          [-c commits] [-E rated_erase_cycles] [-r commits_per_day] [-a crc32|crc32c|xxh64]\n" \
+              "          [-b reboot_every] [-B banks] [-N] [-o wear.csv]\n"
+
+int main(int argc, char* argv[])
+{
+    sim.app_data_num_bytes = 1024;
+    sim.num_copies         = 3;
+    sim.num_pages          = 16;
+    sim.page_num_bytes     = 4096;
+    sim.num_commits        = 1000000;
+    sim.rated_erase_cycles = 100000;
+    sim.commits_per_day    = 1000.0;
+    sim.integrity          = &flash_integrity_crc32;
+
+    int opt;
+    while((opt = getopt(argc, argv, "d:n:p:s:S:c:E:r:a:b:B:No:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'd': sim.app_data_num_bytes = (uint32_t)strtoul(optarg, NULL, 0);  break;
+            case 'n': sim.num_copies         = (uint32_t)strtoul(optarg, NULL, 0);  break;
+            case 'p': sim.num_pages          = (uint32_t)strtoul(optarg, NULL, 0);  break;
+            case 's': sim.page_num_bytes     = (uint32_t)strtoul(optarg, NULL, 0);  break;
+            case 'S': sim.pages_per_sector   = (uint32_t)strtoul(optarg, NULL, 0);  break;
+            case 'c': sim.num_commits        = strtoull(optarg, NULL, 0);           break;
+            case 'E': sim.rated_erase_cycles = strtoull(optarg, NULL, 0);           break;
+            case 'r': sim.commits_per_day    = strtod(optarg, NULL);                break;
+            case 'b': sim.reboot_every       = (uint32_t)strtoul(optarg, NULL, 0);  break;
+            case 'B': sim.num_banks          = (uint32_t)strtoul(optarg, NULL, 0);  break;
+            case 'N': sim.nor                = true;                                break;
+            case 'o': sim.csv_path           = optarg;                              break;
+            case 'a':
+                sim.integrity = NULL;
+                for(uint32_t id = FLASH_INTEGRITY_ID_CRC32; id <= FLASH_INTEGRITY_ID_XXH64; ++id)
+                {
+                    if(strcmp(flash_integrity_builtin(id)->name, optarg) == 0)
+                    {
+                        sim.integrity = flash_integrity_builtin(id);
+                    }
+                }
+                break;
+            default:
+                fprintf(stderr, USAGE, argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if((sim.integrity == NULL) || (sim.app_data_num_bytes == 0) || (sim.num_copies < 2) ||
+       (sim.num_copies > CFG_APP_DATA_MAX_COPIES) || (sim.num_pages == 0) || (sim.page_num_bytes == 0) ||
+       (sim.num_commits == 0) || (sim.commits_per_day <= 0.0) || (sim.num_banks > LL_FLASH_STUB_MAX_BANKS) ||
+       (sim.num_banks > sim.num_pages) ||
+       ((sim.num_banks > 1) && (sim.num_copies > sim.num_banks) && ((sim.num_copies % sim.num_banks) != 0)) ||
+       (optind != argc))
+    {
+        fprintf(stderr, USAGE, argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(!setup())
+    {
+        fprintf(stderr, "endurance_sim: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    double start = now_s();
+    if(!run())
+    {
+        return EXIT_FAILURE;
+    }
+    report(now_s() - start);
+
+    if((sim.csv_path != NULL) && !write_csv())
+    {
+        fprintf(stderr, "endurance_sim: could not write %s\n", sim.csv_path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,387 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "harness.h"
+#include "flash.h"
+#include "ll_flash_stub.h"
+
+/*
+Power-loss fault-injection campaign.
+
+Commits a baseline app data version, then sweeps every cut point of a
+workload of N further commits. A cut point is (program/erase op k, byte
+offset b): only the first b bytes of op k reach the flash, then power is lost.
+
+For each cut point the device image is restored, the workload re-run until
+power is lost, then the device is rebooted (flash_init). The recovered app
+data must match either the version being committed or the one before it.
+With -f a follow-up commit + reboot checks the recovered state is still usable.
+
+Cut points are spread across forked workers, each holding its own copy of
+the in-memory device image. Failing cut points are reported as ranges.
+
+usage: fault_campaign [-f] [-c commits] [-s program_stride] [-e erase_stride] [-j workers] [-r seed]
+*/
+
+typedef enum
+{
+    outcome_ok,
+    outcome_init_failed,     // reboot found no usable copy
+    outcome_wrong_version,   // reboot recovered data matching neither candidate
+    outcome_follow_up_failed // recovered fine, but the next commit / reboot did not
+} outcome_t;
+
+static const char* outcome_str[] = {
+    "ok", "data loss (init failed)", "wrong version recovered", "follow-up commit lost",
+};
+
+typedef struct
+{
+    ll_flash_stub_op_t type;
+    uint32_t addr;
+    uint32_t num_bytes;
+    uint32_t commit_idx;
+} op_record_t;
+
+typedef struct
+{
+    uint32_t op_idx;
+    uint32_t byte_offset;
+    uint32_t outcome;
+    int32_t  init_status;
+} failure_t;
+
+static struct {
+    uint32_t num_commits;
+    uint32_t program_stride;
+    uint32_t erase_stride;
+    uint32_t num_workers;
+    uint32_t seed;
+    bool follow_up;
+
+    uint8_t*  baseline_image;
+    uint32_t  image_num_bytes;
+    uint8_t** versions; // [0] baseline, [1..num_commits] workload commits
+    uint32_t  app_data_len;
+
+    op_record_t* ops;
+    uint32_t num_ops;
+    uint32_t ops_capacity;
+    uint32_t current_commit;
+} campaign;
+
+static void record_op(ll_flash_stub_op_t op, uint32_t addr, uint32_t num_bytes)
+{
+    if(campaign.num_ops == campaign.ops_capacity)
+    {
+        campaign.ops_capacity = campaign.ops_capacity ? campaign.ops_capacity * 2 : 64;
+        campaign.ops = realloc(campaign.ops, campaign.ops_capacity * sizeof(op_record_t));
+        if(campaign.ops == NULL)
+        {
+            perror("fault_campaign: realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    campaign.ops[campaign.num_ops++] = (op_record_t){
+        .type = op, .addr = addr, .num_bytes = num_bytes, .commit_idx = campaign.current_commit,
+    };
+}
+
+// Deterministic app data for a version
+static void fill_version(uint8_t* data, uint32_t num_bytes, uint32_t version)
+{
+    uint32_t x = campaign.seed * 2654435761u + version * 40503u + 1u;
+    for(uint32_t idx = 0; idx < num_bytes; ++idx)
+    {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        data[idx] = (uint8_t)x;
+    }
+}
+
+static bool commit(uint32_t version)
+{
+    harness_stage_app_data(campaign.versions[version], campaign.app_data_len);
+    harness_dispatch(harness_op_update_app_data);
+    return (harness_dispatch(harness_op_write) == flash_status_ok);
+}
+
+static bool app_data_is(uint32_t version)
+{
+    return (memcmp(harness_app_data(), campaign.versions[version], campaign.app_data_len) == 0);
+}
+
+static void restore_baseline(void)
+{
+    ll_flash_stub_image_import(campaign.baseline_image);
+}
+
+// Runs the workload with power lost at (op_idx, byte_offset) then reboots
+static outcome_t run_cut_point(uint32_t op_idx, uint32_t byte_offset, int32_t* init_status)
+{
+    restore_baseline();
+    harness_dispatch(harness_op_init);
+
+    ll_flash_stub_set_power_cut(op_idx, byte_offset);
+
+    uint32_t version = 1;
+    for(; version <= campaign.num_commits; ++version)
+    {
+        commit(version);
+        if(ll_flash_stub_power_lost())
+        {
+            break;
+        }
+    }
+    // Cut point is past the end of the workload, everything committed
+    if(version > campaign.num_commits)
+    {
+        version = campaign.num_commits;
+    }
+
+    ll_flash_stub_clear_power_cut();
+    *init_status = harness_dispatch(harness_op_init);
+
+    if(*init_status != flash_status_ok)
+    {
+        return outcome_init_failed;
+    }
+
+    if(!app_data_is(version) && !app_data_is(version - 1))
+    {
+        return outcome_wrong_version;
+    }
+
+    if(!campaign.follow_up)
+    {
+        return outcome_ok;
+    }
+
+    // Device must still accept and recover a new commit
+    uint32_t follow_up = (version == campaign.num_commits) ? 0 : campaign.num_commits;
+    if(!commit(follow_up) || (harness_dispatch(harness_op_init) != flash_status_ok) || !app_data_is(follow_up))
+    {
+        return outcome_follow_up_failed;
+    }
+
+    return outcome_ok;
+}
+
+static uint32_t op_stride(const op_record_t* op)
+{
+    return (op->type == ll_flash_stub_op_erase) ? campaign.erase_stride : campaign.program_stride;
+}
+
+static void run_worker(uint32_t worker_idx, int fd)
+{
+    uint64_t cut_idx = 0;
+
+    for(uint32_t op_idx = 0; op_idx < campaign.num_ops; ++op_idx)
+    {
+        const op_record_t* op = &campaign.ops[op_idx];
+
+        for(uint32_t offset = 0; offset < op->num_bytes; offset += op_stride(op), ++cut_idx)
+        {
+            if((cut_idx % campaign.num_workers) != worker_idx)
+            {
+                continue;
+            }
+
+            failure_t failure = { .op_idx = op_idx, .byte_offset = offset };
+            failure.outcome = run_cut_point(op_idx, offset, &failure.init_status);
+
+            if((failure.outcome != outcome_ok) &&
+               (write(fd, &failure, sizeof(failure)) != (ssize_t)sizeof(failure)))
+            {
+                perror("fault_campaign: write");
+                _exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    _exit(EXIT_SUCCESS);
+}
+
+static int compare_failures(const void* a, const void* b)
+{
+    const failure_t* fa = a;
+    const failure_t* fb = b;
+    if(fa->op_idx != fb->op_idx)
+    {
+        return (fa->op_idx < fb->op_idx) ? -1 : 1;
+    }
+    return (fa->byte_offset < fb->byte_offset) ? -1 : (fa->byte_offset > fb->byte_offset);
+}
+
+// Prints runs of failures with the same op and outcome as one line
+static void report(failure_t* failures, uint32_t num_failures)
+{
+    qsort(failures, num_failures, sizeof(failure_t), compare_failures);
+
+    for(uint32_t start = 0, end; start < num_failures; start = end)
+    {
+        const op_record_t* op = &campaign.ops[failures[start].op_idx];
+
+        for(end = start + 1; end < num_failures; ++end)
+        {
+            if((failures[end].op_idx != failures[start].op_idx) ||
+               (failures[end].outcome != failures[start].outcome) ||
+               (failures[end].init_status != failures[start].init_status) ||
+               (failures[end].byte_offset != failures[end - 1].byte_offset + op_stride(op)))
+            {
+                break;
+            }
+        }
+
+        printf("FAIL commit %u op %u (%s @+0x%06x, %u B) offsets %u..%u: %s (init status %d)\n",
+               op->commit_idx, failures[start].op_idx,
+               (op->type == ll_flash_stub_op_erase) ? "erase" : "program",
+               op->addr, op->num_bytes,
+               failures[start].byte_offset, failures[end - 1].byte_offset,
+               outcome_str[failures[start].outcome], failures[start].init_status);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    campaign.num_commits    = 1;
+    campaign.program_stride = 1;
+    campaign.erase_stride   = 4096;
+    campaign.num_workers    = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt;
+    while((opt = getopt(argc, argv, "fc:s:e:j:r:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'f': campaign.follow_up      = true;                     break;
+            case 'c': campaign.num_commits    = (uint32_t)atoi(optarg); break;
+            case 's': campaign.program_stride = (uint32_t)atoi(optarg); break;
+            case 'e': campaign.erase_stride   = (uint32_t)atoi(optarg); break;
+            case 'j': campaign.num_workers    = (uint32_t)atoi(optarg); break;
+            case 'r': campaign.seed           = (uint32_t)atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-f] [-c commits] [-s program_stride] [-e erase_stride] [-j workers] [-r seed]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if((campaign.num_commits == 0) || (campaign.program_stride == 0) ||
+       (campaign.erase_stride == 0) || (campaign.num_workers == 0))
+    {
+        fprintf(stderr, "fault_campaign: arguments must be non-zero\n");
+        return EXIT_FAILURE;
+    }
+
+    // Versions of the app data, 0 is the baseline
+    campaign.app_data_len = harness_app_data_len();
+    campaign.versions = calloc(campaign.num_commits + 1, sizeof(uint8_t*));
+    for(uint32_t version = 0; version <= campaign.num_commits; ++version)
+    {
+        campaign.versions[version] = malloc(campaign.app_data_len);
+        fill_version(campaign.versions[version], campaign.app_data_len, version);
+    }
+
+    // Baseline: device holding version 0
+    harness_set_verbose(false);
+    harness_reset(false);
+    harness_dispatch(harness_op_init);
+    if(!commit(0))
+    {
+        fprintf(stderr, "fault_campaign: baseline commit failed\n");
+        return EXIT_FAILURE;
+    }
+
+    campaign.image_num_bytes = ll_flash_stub_image_num_bytes();
+    campaign.baseline_image  = malloc(campaign.image_num_bytes);
+    ll_flash_stub_image_export(campaign.baseline_image);
+
+    // Dry run to record the program / erase ops of the workload
+    harness_dispatch(harness_op_init);
+    ll_flash_stub_set_op_hook(record_op);
+    for(campaign.current_commit = 1; campaign.current_commit <= campaign.num_commits; ++campaign.current_commit)
+    {
+        if(!commit(campaign.current_commit))
+        {
+            fprintf(stderr, "fault_campaign: workload commit %u failed without faults\n", campaign.current_commit);
+            return EXIT_FAILURE;
+        }
+    }
+    ll_flash_stub_set_op_hook(NULL);
+
+    uint64_t num_cut_points = 0;
+    for(uint32_t op_idx = 0; op_idx < campaign.num_ops; ++op_idx)
+    {
+        const op_record_t* op = &campaign.ops[op_idx];
+        num_cut_points += (op->num_bytes + op_stride(op) - 1) / op_stride(op);
+    }
+
+    printf("fault_campaign: %u commit(s), %u ops, %llu cut points, %u worker(s)\n",
+           campaign.num_commits, campaign.num_ops, (unsigned long long)num_cut_points, campaign.num_workers);
+
+    struct timespec t_start, t_end;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+    int fds[2];
+    if(pipe(fds) != 0)
+    {
+        perror("fault_campaign: pipe");
+        return EXIT_FAILURE;
+    }
+
+    for(uint32_t worker_idx = 0; worker_idx < campaign.num_workers; ++worker_idx)
+    {
+        pid_t pid = fork();
+        if(pid < 0)
+        {
+            perror("fault_campaign: fork");
+            return EXIT_FAILURE;
+        }
+        if(pid == 0)
+        {
+            close(fds[0]);
+            run_worker(worker_idx, fds[1]);
+        }
+    }
+    close(fds[1]);
+
+    // Collect failures until every worker has closed its end of the pipe
+    failure_t* failures = NULL;
+    uint32_t num_failures = 0, failures_capacity = 0;
+    failure_t failure;
+    while(read(fds[0], &failure, sizeof(failure)) == (ssize_t)sizeof(failure))
+    {
+        if(num_failures == failures_capacity)
+        {
+            failures_capacity = failures_capacity ? failures_capacity * 2 : 256;
+            failures = realloc(failures, failures_capacity * sizeof(failure_t));
+        }
+        failures[num_failures++] = failure;
+    }
+    close(fds[0]);
+
+    bool workers_ok = true;
+    int wstatus;
+    while(wait(&wstatus) > 0)
+    {
+        workers_ok &= (WIFEXITED(wstatus) && (WEXITSTATUS(wstatus) == EXIT_SUCCESS));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    double elapsed = (double)(t_end.tv_sec - t_start.tv_sec) + (double)(t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+
+    report(failures, num_failures);
+    printf("fault_campaign: %u of %llu cut points failed, %.2f s (%.0f cut points/s)\n",
+           num_failures, (unsigned long long)num_cut_points, elapsed, (double)num_cut_points / elapsed);
+
+    if(!workers_ok)
+    {
+        fprintf(stderr, "fault_campaign: worker(s) exited abnormally\n");
+        return EXIT_FAILURE;
+    }
+
+    return (num_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,653 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flash.h"
+#include "flash_conf.h"
+#include "page_table.h"
+#include "ll_flash_stub.h"
+
+/*
+Page table and large geometry check.
+
+Lookup: every page of each geometry is probed at its first, middle and last
+byte, one byte either side of it and at random addresses, and page_table_lookup
+must agree with a linear walk over the descriptors. Covers the O(1) uniform path
+and the binary search (mixed page sizes, address gaps). Sector lower bound is
+checked the same way against a table holding sectors and blocks.
+
+Store: flash_init + commits + reboots on each geometry with runtime copy counts
+above the default, the last commit must be recovered and every copy retained.
+Each run backs the stub with a different page allocator: the 16 MiB uniform part
+in a hugepage mmap region, the gapped part in an arena of only the packed page
+bytes (gaps cost nothing), a 64 KiB part in an arena of exactly its size. An arena
+a page short of the device must fail flash_init.
+
+Copy layout: flash_init must take a well formed precomputed copy_layout and refuse
+(flash_status_invalid_config) spans out of bounds, too small for a copy,
+overlapping, across an address gap or across banks, a single copy and copies
+split unevenly over the banks, then still accept a corrected configuration.
+
+    uniform   4096 x 4 KiB pages, 64 KiB blocks, 5 and 8 copies (heap, hugepage mmap)
+    mixed     4/8/16 KiB pages with a gap after every third page, 6 copies (arena)
+    stm32     4 x 16 KiB, 64 KiB, 7 x 128 KiB (F4 style), 4 copies (mmap)
+    small     16 x 4 KiB pages, 3 copies (64 KiB arena, then one a page short)
+
+Banks: the stub's read-while-write model must take sparse bank ids (0, 1, 5) and
+count ops against each, and must not look at ids at all while its timing is zero.
+flash_init must deal copies over the first flash_config_t.num_banks banks of the
+part and refuse more banks than it supports or than the pages hold.
+
+usage: geometry_check
+*/
+
+#define DEVICE_BASE_ADDR   0x08000000UL
+#define NUM_RANDOM_PROBES  100000
+#define NUM_COMMITS        20
+#define REBOOT_EVERY       3
+
+typedef struct
+{
+    const char*   name;
+    page_dsc_t*   pages;
+    uint32_t      num_pages;
+    sector_dsc_t* sectors;
+    uint32_t      num_sectors;
+    bool          uniform;
+} geometry_t;
+
+static uint32_t num_failures;
+
+static void fail(const char* geometry, const char* what, uint32_t value)
+{
+    ++num_failures;
+    printf("geometry_check: %s: %s (0x%08x)\n", geometry, what, value);
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec * 1e-3;
+}
+
+// Reference lookup
+static bool linear_lookup(const geometry_t* geo, uint32_t addr, uint32_t* page_idx, uint32_t* page_offset)
+{
+    for(uint32_t idx = 0; idx < geo->num_pages; ++idx)
+    {
+        if((addr >= geo->pages[idx].base_addr) && ((addr - geo->pages[idx].base_addr) < geo->pages[idx].size_bytes))
+        {
+            *page_idx = idx;
+            *page_offset = addr - geo->pages[idx].base_addr;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void probe(const geometry_t* geo, const page_table_t* table, uint32_t addr)
+{
+    uint32_t ref_idx = 0, ref_offset = 0, idx = 0, offset = 0;
+    bool ref_found = linear_lookup(geo, addr, &ref_idx, &ref_offset);
+    bool found = page_table_lookup(table, addr, &idx, &offset);
+
+    if(found != ref_found)
+    {
+        fail(geo->name, ref_found ? "address not found" : "address in a gap found", addr);
+    }
+    else if(found && ((idx != ref_idx) || (offset != ref_offset)))
+    {
+        fail(geo->name, "address resolved to the wrong page", addr);
+    }
+}
+
+static void check_lookup(const geometry_t* geo)
+{
+    page_table_t table;
+    if(!page_table_init(&table, geo->pages, geo->num_pages))
+    {
+        fail(geo->name, "page_table_init rejected the geometry", geo->num_pages);
+        return;
+    }
+    if((table.uniform_page_size != 0) != geo->uniform)
+    {
+        fail(geo->name, "uniform geometry detection", table.uniform_page_size);
+    }
+
+    for(uint32_t idx = 0; idx < geo->num_pages; ++idx)
+    {
+        const page_dsc_t* page = &geo->pages[idx];
+        probe(geo, &table, page->base_addr - 1);
+        probe(geo, &table, page->base_addr);
+        probe(geo, &table, page->base_addr + page->size_bytes / 2);
+        probe(geo, &table, page->base_addr + page->size_bytes - 1);
+        probe(geo, &table, page->base_addr + page->size_bytes);
+    }
+
+    const page_dsc_t* last = &geo->pages[geo->num_pages - 1];
+    uint32_t span = (last->base_addr + last->size_bytes) - geo->pages[0].base_addr;
+    for(uint32_t probe_idx = 0; probe_idx < NUM_RANDOM_PROBES; ++probe_idx)
+    {
+        uint32_t addr = geo->pages[0].base_addr + (uint32_t)(((uint64_t)rand() * (span + 2)) / ((uint64_t)RAND_MAX + 1)) - 1;
+        probe(geo, &table, addr);
+    }
+
+    for(uint32_t page_idx = 0; page_idx <= geo->num_pages; ++page_idx)
+    {
+        uint32_t ref = geo->num_sectors;
+        for(uint32_t sector_idx = 0; sector_idx < geo->num_sectors; ++sector_idx)
+        {
+            if(geo->sectors[sector_idx].first_page_idx == page_idx)
+            {
+                ref = sector_idx;
+                break;
+            }
+        }
+        if(page_table_sector_lower_bound(geo->sectors, geo->num_sectors, page_idx) != ref)
+        {
+            fail(geo->name, "sector lower bound", page_idx);
+        }
+    }
+}
+
+static void check_store(const geometry_t* geo, uint32_t num_copies, uint32_t app_data_num_bytes,
+                        const ll_flash_stub_allocator_t* allocator, const char* memory)
+{
+    static flash_config_t config;
+    uint8_t* app_data = malloc(app_data_num_bytes);
+    uint8_t* expected = malloc(app_data_num_bytes);
+    flash_version_info_t info[CFG_APP_DATA_MAX_COPIES];
+    if((app_data == NULL) || (expected == NULL))
+    {
+        fail(geo->name, "out of memory", app_data_num_bytes);
+        free(app_data);
+        free(expected);
+        return;
+    }
+
+    memset(&config, 0, sizeof(config));
+    config.num_app_data_copies            = num_copies;
+    config.data_descriptor.app_data       = app_data;
+    config.data_descriptor.data_num_bytes = app_data_num_bytes;
+    config.ll.write_granularity           = write_size_32bit;
+    config.ll.pages_total_num             = geo->num_pages;
+    config.ll.page_descriptors            = geo->pages;
+    config.ll.sectors_total_num           = geo->num_sectors;
+    config.ll.sector_descriptors          = geo->sectors;
+
+    // Fresh erased device for every run
+    ll_flash_stub_set_allocator(allocator);
+    ll_flash_stub_set_persistence(false);
+
+    double init_us = 0.0, commit_us = 0.0;
+    uint32_t num_inits = 0;
+    flash_deinit();
+    double start = now_us();
+    flash_status_t status = flash_init(&config);
+    init_us += now_us() - start;
+    ++num_inits;
+    if(status != flash_status_no_valid_data_found)
+    {
+        fail(geo->name, "init of an erased device", status);
+    }
+
+    for(uint32_t commit = 0; (commit < NUM_COMMITS) && (status != flash_status_ll_init_fault); ++commit)
+    {
+        for(uint32_t idx = 0; idx < app_data_num_bytes; ++idx)
+        {
+            app_data[idx] = (uint8_t)(rand() >> 7);
+        }
+        memcpy(expected, app_data, app_data_num_bytes);
+
+        start = now_us();
+        status = flash_write();
+        commit_us += now_us() - start;
+        if(status != flash_status_ok)
+        {
+            fail(geo->name, "commit", status);
+            break;
+        }
+
+        if(((commit + 1) % REBOOT_EVERY) == 0)
+        {
+            memset(app_data, 0, app_data_num_bytes);
+            flash_deinit();
+            start = now_us();
+            status = flash_init(&config);
+            init_us += now_us() - start;
+            ++num_inits;
+            if((status != flash_status_ok) || (memcmp(app_data, expected, app_data_num_bytes) != 0))
+            {
+                fail(geo->name, "reboot did not recover the last commit", status);
+            }
+        }
+    }
+
+    uint32_t num_info = 0;
+    if((flash_versions(info, CFG_APP_DATA_MAX_COPIES, &num_info) != flash_status_ok) || (num_info != num_copies))
+    {
+        fail(geo->name, "copies retained", num_info);
+    }
+    for(uint32_t info_idx = 0; info_idx < num_info; ++info_idx)
+    {
+        if(!info[info_idx].crc_ok || (info[info_idx].version != (NUM_COMMITS - info_idx)))
+        {
+            fail(geo->name, "retained version", info[info_idx].version);
+        }
+    }
+
+    printf("geometry_check: %-8s %5u pages (%u resident, %s), %u copies of %u bytes: init %.0f us, commit %.0f us\n",
+           geo->name, geo->num_pages, ll_flash_stub_num_resident_pages(), memory, num_copies, app_data_num_bytes,
+           init_us / num_inits, commit_us / NUM_COMMITS);
+
+    flash_deinit();
+    free(app_data);
+    free(expected);
+}
+
+static bool build_uniform(geometry_t* geo)
+{
+    const uint32_t pages_per_block = 16;
+    geo->name        = "uniform";
+    geo->num_pages   = 4096;
+    geo->num_sectors = geo->num_pages / pages_per_block;
+    geo->uniform     = true;
+    geo->pages       = calloc(geo->num_pages, sizeof(page_dsc_t));
+    geo->sectors     = calloc(geo->num_sectors, sizeof(sector_dsc_t));
+    if((geo->pages == NULL) || (geo->sectors == NULL))
+    {
+        return false;
+    }
+
+    for(uint32_t idx = 0; idx < geo->num_pages; ++idx)
+    {
+        geo->pages[idx].base_addr  = DEVICE_BASE_ADDR + idx * 4096;
+        geo->pages[idx].size_bytes = 4096;
+    }
+    for(uint32_t idx = 0; idx < geo->num_sectors; ++idx)
+    {
+        geo->sectors[idx].first_page_idx = idx * pages_per_block;
+        geo->sectors[idx].num_pages      = pages_per_block;
+    }
+    return true;
+}
+
+static bool build_mixed(geometry_t* geo)
+{
+    static const uint32_t sizes[] = { 4096, 8192, 16384 };
+    geo->name      = "mixed";
+    geo->num_pages = 1536;
+    geo->uniform   = false;
+    geo->pages     = calloc(geo->num_pages, sizeof(page_dsc_t));
+    // Every page as its own sector, plus a block over each run of three (sectors and blocks interleaved)
+    geo->sectors   = calloc(geo->num_pages + geo->num_pages / 3, sizeof(sector_dsc_t));
+    if((geo->pages == NULL) || (geo->sectors == NULL))
+    {
+        return false;
+    }
+
+    uint32_t addr = DEVICE_BASE_ADDR;
+    geo->num_sectors = 0;
+    for(uint32_t idx = 0; idx < geo->num_pages; ++idx)
+    {
+        geo->pages[idx].base_addr  = addr;
+        geo->pages[idx].size_bytes = sizes[idx % 3];
+        addr += sizes[idx % 3];
+        if((idx % 3) == 2)
+        {
+            addr += 4096;   // gap
+        }
+
+        if((idx % 3) == 0)
+        {
+            geo->sectors[geo->num_sectors].first_page_idx = idx;
+            geo->sectors[geo->num_sectors].num_pages      = 3;
+            ++geo->num_sectors;
+        }
+        geo->sectors[geo->num_sectors].first_page_idx = idx;
+        geo->sectors[geo->num_sectors].num_pages      = 1;
+        ++geo->num_sectors;
+    }
+    return true;
+}
+
+static bool build_stm32(geometry_t* geo)
+{
+    geo->name        = "stm32";
+    geo->num_pages   = 12;
+    geo->num_sectors = 0;
+    geo->uniform     = false;
+    geo->pages       = calloc(geo->num_pages, sizeof(page_dsc_t));
+    geo->sectors     = NULL;
+    if(geo->pages == NULL)
+    {
+        return false;
+    }
+
+    uint32_t addr = DEVICE_BASE_ADDR;
+    for(uint32_t idx = 0; idx < geo->num_pages; ++idx)
+    {
+        uint32_t size = (idx < 4) ? NUM_KB_TO_NUM_BYTE(16) : ((idx == 4) ? NUM_KB_TO_NUM_BYTE(64) : NUM_KB_TO_NUM_BYTE(128));
+        geo->pages[idx].base_addr  = addr;
+        geo->pages[idx].size_bytes = size;
+        addr += size;
+    }
+    return true;
+}
+
+static bool build_small(geometry_t* geo)
+{
+    geo->name        = "small";
+    geo->num_pages   = 16;
+    geo->num_sectors = 0;
+    geo->uniform     = true;
+    geo->pages       = calloc(geo->num_pages, sizeof(page_dsc_t));
+    geo->sectors     = NULL;
+    if(geo->pages == NULL)
+    {
+        return false;
+    }
+
+    for(uint32_t idx = 0; idx < geo->num_pages; ++idx)
+    {
+        geo->pages[idx].base_addr  = DEVICE_BASE_ADDR + idx * 4096;
+        geo->pages[idx].size_bytes = 4096;
+    }
+    return true;
+}
+
+// Sum of the page sizes, what a region allocator has to hold whatever the gaps
+static size_t packed_num_bytes(const geometry_t* geo)
+{
+    size_t num_bytes = 0;
+    for(uint32_t idx = 0; idx < geo->num_pages; ++idx)
+    {
+        num_bytes += geo->pages[idx].size_bytes;
+    }
+    return num_bytes;
+}
+
+// An arena a page short of the device can't hold it, the ll init (and so flash_init) fails
+static void check_arena_too_small(const geometry_t* geo, uint8_t* buffer)
+{
+    static uint8_t app_data[64];
+    static flash_config_t config;
+    ll_flash_stub_arena_t arena = { .base = buffer, .num_bytes = packed_num_bytes(geo) - geo->pages[0].size_bytes };
+    const ll_flash_stub_allocator_t allocator = ll_flash_stub_arena_allocator(&arena);
+
+    memset(&config, 0, sizeof(config));
+    config.num_app_data_copies            = 2;
+    config.data_descriptor.app_data       = app_data;
+    config.data_descriptor.data_num_bytes = sizeof(app_data);
+    config.ll.write_granularity           = write_size_32bit;
+    config.ll.pages_total_num             = geo->num_pages;
+    config.ll.page_descriptors            = geo->pages;
+
+    ll_flash_stub_set_allocator(&allocator);
+    ll_flash_stub_set_persistence(false);
+    flash_deinit();
+    if(flash_init(&config) != flash_status_ll_init_fault)
+    {
+        fail(geo->name, "arena smaller than the device accepted", (uint32_t)arena.num_bytes);
+    }
+    flash_deinit();
+}
+
+// Commits num_commits times on a 12 x 4 KiB part with the given bank ids per 4 pages,
+// copies dealt over num_banks of them
+static flash_status_t commit_on_banks(const uint32_t bank_ids[3], uint32_t num_banks, uint32_t num_copies,
+                                      uint32_t num_commits)
+{
+    static page_dsc_t pages[12];
+    static uint8_t app_data[1000];
+    static flash_config_t config;
+
+    for(uint32_t idx = 0; idx < 12; ++idx)
+    {
+        pages[idx] = (page_dsc_t){ DEVICE_BASE_ADDR + idx * 4096, 4096, bank_ids[idx / 4] };
+    }
+
+    memset(&config, 0, sizeof(config));
+    config.num_app_data_copies            = num_copies;
+    config.num_banks                      = num_banks;
+    config.data_descriptor.app_data       = app_data;
+    config.data_descriptor.data_num_bytes = sizeof(app_data);
+    config.ll.write_granularity           = write_size_32bit;
+    config.ll.pages_total_num             = 12;
+    config.ll.page_descriptors            = pages;
+
+    const ll_flash_stub_allocator_t heap = ll_flash_stub_heap_allocator();
+    ll_flash_stub_set_allocator(&heap);
+    ll_flash_stub_set_persistence(false);
+
+    flash_deinit();
+    flash_status_t status = flash_init(&config);
+    if((status != flash_status_ok) && (status != flash_status_no_valid_data_found))
+    {
+        flash_deinit();
+        return status;
+    }
+    for(uint32_t commit = 0; commit < num_commits; ++commit)
+    {
+        app_data[0] = (uint8_t)commit;
+        status = flash_write();
+        if(status != flash_status_ok)
+        {
+            break;
+        }
+    }
+    flash_deinit();
+    return status;
+}
+
+static void check_banks(void)
+{
+    const ll_flash_stub_bank_timing_t timing = { .erase_ticks_per_page = 200, .program_ticks_per_word = 1 };
+    const ll_flash_stub_bank_timing_t no_timing = { 0 };
+
+    // Sparse ids, every bank takes a copy and its share of the ops
+    ll_flash_stub_set_bank_timing(&timing);
+    if(commit_on_banks((const uint32_t[3]){ 0, 1, 5 }, 3, 3, 9) != flash_status_ok)
+    {
+        fail("banks", "commits on banks 0, 1, 5", 5);
+    }
+    for(uint32_t bank = 0; bank < 6; ++bank)
+    {
+        ll_flash_stub_bank_stats_t stats;
+        bool tracked = ll_flash_stub_bank_stats(bank, &stats);
+        if(tracked != ((bank == 0) || (bank == 1) || (bank == 5)))
+        {
+            fail("banks", "bank id tracking", bank);
+        }
+        else if(tracked && (stats.ops == 0))
+        {
+            fail("banks", "no ops counted against bank", bank);
+        }
+    }
+
+    // Copies must split evenly, 3 over 2 banks would leave one copy taking every other commit
+    if(commit_on_banks((const uint32_t[3]){ 0, 1, 1 }, 2, 3, 1) != flash_status_invalid_config)
+    {
+        fail("banks", "uneven bank shares accepted", 3);
+    }
+    if(commit_on_banks((const uint32_t[3]){ 0, 1, 1 }, 2, 4, 9) != flash_status_ok)
+    {
+        fail("banks", "commits with 2 copies per bank", 4);
+    }
+
+    // More banks than flash_init spreads copies over, or than the pages hold, is a status,
+    // fewer take the first banks of the part (in page order)
+    static const page_dsc_t five_banks[5] = {
+        { DEVICE_BASE_ADDR + 0x0000, 4096, 0 }, { DEVICE_BASE_ADDR + 0x1000, 4096, 1 }, { DEVICE_BASE_ADDR + 0x2000, 4096, 2 },
+        { DEVICE_BASE_ADDR + 0x3000, 4096, 3 }, { DEVICE_BASE_ADDR + 0x4000, 4096, 4 },
+    };
+    static const struct {
+        const char* what;
+        uint32_t num_banks;
+        flash_status_t status;
+    } five_bank_cases[] = {
+        { "more than FLASH_MAX_BANKS banks accepted", FLASH_MAX_BANKS + 1, flash_status_invalid_config },
+        { "copies over the first 2 of 5 banks",       2,                   flash_status_no_valid_data_found },
+    };
+    static uint8_t app_data[1000];
+    static flash_config_t config;
+    for(uint32_t case_idx = 0; case_idx < (sizeof(five_bank_cases) / sizeof(five_bank_cases[0])); ++case_idx)
+    {
+        memset(&config, 0, sizeof(config));
+        config.num_app_data_copies            = 2;
+        config.num_banks                      = five_bank_cases[case_idx].num_banks;
+        config.data_descriptor.app_data       = app_data;
+        config.data_descriptor.data_num_bytes = sizeof(app_data);
+        config.ll.write_granularity           = write_size_32bit;
+        config.ll.pages_total_num             = 5;
+        config.ll.page_descriptors            = five_banks;
+        flash_deinit();
+        flash_status_t status = flash_init(&config);
+        if(status != five_bank_cases[case_idx].status)
+        {
+            fail("banks", five_bank_cases[case_idx].what, status);
+        }
+    }
+    flash_deinit();
+    if(commit_on_banks((const uint32_t[3]){ 0, 0, 0 }, 2, 2, 1) != flash_status_invalid_config)
+    {
+        fail("banks", "2 banks configured on a single bank part", 2);
+    }
+
+    // No timing, no model: ids beyond the tracked range are fine
+    ll_flash_stub_set_bank_timing(&no_timing);
+    if(commit_on_banks((const uint32_t[3]){ 9, 9, 9 }, 1, 3, 9) != flash_status_ok)
+    {
+        fail("banks", "commits on bank 9 without a timing", 9);
+    }
+    printf("geometry_check: banks    sparse ids, even shares and untimed model\n");
+}
+
+static void check_copy_layout(void)
+{
+    // 4 KiB pages, 0..3 in bank 0, 4..7 in bank 1 with a gap before page 6
+    static const page_dsc_t pages[] = {
+        { 0x08000000, 0x1000, 0 }, { 0x08001000, 0x1000, 0 }, { 0x08002000, 0x1000, 0 }, { 0x08003000, 0x1000, 0 },
+        { 0x08004000, 0x1000, 1 }, { 0x08005000, 0x1000, 1 }, { 0x08010000, 0x1000, 1 }, { 0x08011000, 0x1000, 1 },
+    };
+    static const struct {
+        const char* what;
+        flash_copy_span_t spans[2];
+        flash_status_t status;
+    } cases[] = {
+        { "well formed",      { { 0, 2 }, { 4, 2 } },          flash_status_no_valid_data_found },
+        { "zero pages",       { { 0, 2 }, { 4, 0 } },          flash_status_invalid_config },
+        { "past the pages",   { { 0, 2 }, { 7, 2 } },          flash_status_invalid_config },
+        { "index overflow",   { { 0, 2 }, { UINT32_MAX, 2 } }, flash_status_invalid_config },
+        { "too small",        { { 0, 1 }, { 4, 2 } },          flash_status_invalid_config },
+        { "overlapping",      { { 0, 2 }, { 1, 2 } },          flash_status_invalid_config },
+        { "across a gap",     { { 0, 2 }, { 5, 2 } },          flash_status_invalid_config },
+        { "across banks",     { { 0, 2 }, { 3, 2 } },          flash_status_invalid_config },
+    };
+    static uint8_t app_data[6000];
+    static flash_config_t config;
+
+    for(uint32_t case_idx = 0; case_idx < (sizeof(cases) / sizeof(cases[0])); ++case_idx)
+    {
+        memset(&config, 0, sizeof(config));
+        config.num_app_data_copies            = 2;
+        config.copy_layout                    = cases[case_idx].spans;
+        config.data_descriptor.app_data       = app_data;
+        config.data_descriptor.data_num_bytes = sizeof(app_data);
+        config.ll.write_granularity           = write_size_32bit;
+        config.ll.pages_total_num             = sizeof(pages) / sizeof(pages[0]);
+        config.ll.page_descriptors            = pages;
+
+        const ll_flash_stub_allocator_t heap = ll_flash_stub_heap_allocator();
+        ll_flash_stub_set_allocator(&heap);
+        ll_flash_stub_set_persistence(false);
+
+        flash_deinit();
+        flash_status_t status = flash_init(&config);
+        if(status != cases[case_idx].status)
+        {
+            fail("layout", cases[case_idx].what, status);
+        }
+    }
+
+    // A single copy would be erased in place by every commit
+    config.num_app_data_copies = 1;
+    config.copy_layout         = NULL;
+    flash_deinit();
+    if(flash_init(&config) != flash_status_invalid_config)
+    {
+        fail("layout", "single copy accepted", 1);
+    }
+
+    // Two copies in bank 0 against one in bank 1, the lone copy would take every other commit
+    static const flash_copy_span_t uneven[3] = { { 0, 2 }, { 2, 2 }, { 4, 2 } };
+    config.num_app_data_copies = 3;
+    config.copy_layout         = uneven;
+    flash_deinit();
+    if(flash_init(&config) != flash_status_invalid_config)
+    {
+        fail("layout", "uneven bank shares accepted", 3);
+    }
+
+    // A refused configuration leaves the module uninitialized, a corrected one may follow
+    config.num_app_data_copies = 2;
+    config.copy_layout         = cases[0].spans;
+    if(flash_init(&config) != cases[0].status)
+    {
+        fail("layout", "init after a refused configuration", 2);
+    }
+
+    flash_deinit();
+    printf("geometry_check: layout   %u copy_layout cases\n", (uint32_t)(sizeof(cases) / sizeof(cases[0])));
+}
+
+int main(void)
+{
+    geometry_t uniform, mixed, stm32, small;
+    srand(1);
+
+    if(!build_uniform(&uniform) || !build_mixed(&mixed) || !build_stm32(&stm32) || !build_small(&small))
+    {
+        fprintf(stderr, "geometry_check: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    // Arenas hold the packed pages only, the address span of the gapped part is larger
+    ll_flash_stub_arena_t mixed_arena = { .base = malloc(packed_num_bytes(&mixed)), .num_bytes = packed_num_bytes(&mixed) };
+    static uint8_t small_buffer[64 * 1024];
+    ll_flash_stub_arena_t small_arena = { .base = small_buffer, .num_bytes = sizeof(small_buffer) };
+    if((mixed_arena.base == NULL) || (packed_num_bytes(&small) != sizeof(small_buffer)))
+    {
+        fprintf(stderr, "geometry_check: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    // The hugepage allocator is made before the plain one, each keeps its own flag
+    const ll_flash_stub_allocator_t heap      = ll_flash_stub_heap_allocator();
+    const ll_flash_stub_allocator_t huge_mmap = ll_flash_stub_mmap_allocator(true);
+    const ll_flash_stub_allocator_t mmap      = ll_flash_stub_mmap_allocator(false);
+    const ll_flash_stub_allocator_t mixed_mem = ll_flash_stub_arena_allocator(&mixed_arena);
+    const ll_flash_stub_allocator_t small_mem = ll_flash_stub_arena_allocator(&small_arena);
+
+    check_lookup(&uniform);
+    check_lookup(&mixed);
+    check_lookup(&stm32);
+
+    check_store(&uniform, 5, 10000, &heap, "heap");
+    check_store(&uniform, CFG_APP_DATA_MAX_COPIES, 10000, &huge_mmap, "hugepage mmap");
+    check_store(&mixed, 6, 20000, &mixed_mem, "packed arena");
+    check_store(&stm32, 4, 8192, &mmap, "mmap");
+    check_store(&small, 3, 4000, &small_mem, "64 KiB arena");
+    check_arena_too_small(&small, small_buffer);
+
+    check_copy_layout();
+    check_banks();
+
+    // Drop the mapping and stop using the arenas before they go away
+    ll_flash_stub_set_allocator(&heap);
+    free(mixed_arena.base);
+
+    printf("geometry_check: %u failure(s)\n", num_failures);
+    return (num_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,124 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "flash.hpp"
+#include "ll_flash_stub.h"
+
+/*
+flash::Store example, doubles as a check of the C++ facade.
+
+Describes a small two bank part as a constexpr Layout, lets Store place four
+copies of a settings struct at compile time (two per bank), then commits a few
+versions, reads an older one back, rolls back to it and power cycles (a second
+Store over the same in-memory stub image), scrubbing the history on the way.
+Built with -Wall -Wextra -Werror, exits non-zero when any step goes wrong.
+
+usage: store_example
+*/
+
+namespace
+{
+
+struct Settings
+{
+    uint32_t volume;
+    uint32_t brightness;
+    char     name[16];
+};
+
+// 8 x 4 KiB pages, the upper half in a second read-while-write bank. The lower bank erases
+// as 8 KiB sectors nested in a 16 KiB block, the upper one as a 16 KiB block
+struct Layout
+{
+    static constexpr std::array<page_dsc_t, 8> pages = {{
+        { 0x08000000, 0x1000, 0 }, { 0x08001000, 0x1000, 0 }, { 0x08002000, 0x1000, 0 }, { 0x08003000, 0x1000, 0 },
+        { 0x08004000, 0x1000, 1 }, { 0x08005000, 0x1000, 1 }, { 0x08006000, 0x1000, 1 }, { 0x08007000, 0x1000, 1 },
+    }};
+    static constexpr std::array<sector_dsc_t, 4> sectors = {{ { 0, 2 }, { 0, 4 }, { 2, 2 }, { 4, 4 } }};
+    static constexpr std::array<uint32_t, 0> flash_keys = {};
+    static constexpr flash_write_size_t write_granularity = write_size_32bit;
+    static constexpr uint32_t num_copies = 4;
+};
+
+using SettingsStore = flash::Store<Layout, Settings>;
+
+uint32_t num_failures;
+
+void expect(bool ok, const char* what)
+{
+    if(!ok)
+    {
+        ++num_failures;
+        std::printf("store_example: %s\n", what);
+    }
+}
+
+bool same(const Settings& lhs, const Settings& rhs)
+{
+    return std::memcmp(&lhs, &rhs, sizeof(Settings)) == 0;
+}
+
+} // namespace
+
+int main()
+{
+    ll_flash_stub_set_persistence(false);
+
+    const Settings first  = { 3, 50, "first" };
+    const Settings second = { 7, 80, "second" };
+    const Settings third  = { 9, 20, "third" };
+
+    {
+        SettingsStore store;
+        expect(store.init() == flash_status_no_valid_data_found, "init of an erased part");
+
+        expect(store.write(first) == flash_status_ok, "commit of version 1");
+        store.data() = second;
+        expect(store.commit() == flash_status_ok, "commit of version 2");
+        expect(store.write(third) == flash_status_ok, "commit of version 3");
+
+        std::array<flash_version_info_t, SettingsStore::num_copies> info{};
+        uint32_t num_info = 0;
+        expect((store.versions(info, num_info) == flash_status_ok) && (num_info == 3) &&
+               (info[0].version == 3) && info[0].active && (info[0].bank != info[1].bank),
+               "versions newest first, neighbouring copies in different banks");
+
+        Settings old{};
+        expect((store.read_version(1, old) == flash_status_ok) && same(old, first), "read back of version 1");
+
+        while(store.scrub_step(1024) == flash_status_ok)
+        {
+            flash_scrub_stats_t stats;
+            flash_scrub_stats(&stats);
+            if(stats.passes > 0)
+            {
+                break;
+            }
+        }
+        flash_health_t health = flash_health_unchecked;
+        expect((store.health(1, health) == flash_status_ok) && (health == flash_health_ok), "scrub of version 1");
+
+        expect(store.rollback(1) == flash_status_ok, "rollback to version 1");
+        Settings current{};
+        expect((store.read(current) == flash_status_ok) && same(current, first), "read after rollback");
+    }
+
+    // Power cycle, the rollback must stick
+    {
+        SettingsStore store;
+        expect((store.init() == flash_status_ok) && same(store.data(), first), "version 1 active after reboot");
+
+        // The rollback took a sequence number of its own, the commit is the newest listed
+        store.data().volume = 11;
+        expect(store.commit() == flash_status_ok, "commit after rollback");
+        std::array<flash_version_info_t, SettingsStore::num_copies> info{};
+        uint32_t num_info = 0;
+        Settings newest{};
+        expect((store.versions(info, num_info) == flash_status_ok) && (num_info == 4) && info[0].active &&
+               (store.read_version(info[0].version, newest) == flash_status_ok) && (newest.volume == 11),
+               "newest version after rollback");
+    }
+
+    std::printf("store_example: %u failure(s)\n", num_failures);
+    return (num_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
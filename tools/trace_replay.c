@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ll_flash.h"
+#include "ll_flash_stub.h"
+#include "ll_flash_trace.h"
+
+/*
+Replays an ll_flash op trace (see flash_lib/inc/ll_flash_trace.h) against a
+backend and reports the elapsed time per op type, next to the time recorded
+in the trace when it was captured with a clock.
+
+Backends:
+    stub     ll_flash stub, in memory (default)
+    stub-nv  ll_flash stub persisting to nv_state in the working directory
+    nor      ll_flash stub, in memory, NOR program semantics (counted, not strict)
+    null     every op returns immediately, the cost of the replay loop itself
+
+Stub page memory (-m): heap (default), mmap (one mapping sized from the
+traced geometry) or huge (mmap, transparent hugepage backed), see
+ll_flash_stub_set_allocator.
+
+Payloads are not part of a trace, programs use a fixed pattern. Addresses,
+lengths and erase ranges are replayed as recorded, which is what the cost of
+a commit strategy or erase policy depends on.
+
+Traces are captured via ll_trace_start, e.g. FLASH_TRACE=<file> for the CLI
+or --trace <file> for python/flash_test.py --in-process.
+
+usage: trace_replay [-b backend] [-m memory] [-r runs] trace_file
+*/
+
+typedef struct
+{
+    const char* name;
+    void (*setup)(void);
+    ll_flash_status_t (*init)(ll_flash_config_t* ll_config);
+    ll_flash_status_t (*read)(uint32_t addr, uint8_t* data, uint32_t num_bytes);
+    ll_flash_status_t (*write)(uint32_t addr, const uint8_t* data, uint32_t num_bytes);
+    ll_flash_status_t (*range_erase)(uint32_t first_page_idx, uint32_t page_count);
+} backend_t;
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t num_bytes;
+    uint64_t replay_ns;
+    uint64_t recorded_ticks;
+    uint64_t status_mismatches;
+} op_stats_t;
+
+static const char* op_str[] = { "geometry", "init", "read", "write", "erase" };
+#define NUM_TRACE_OPS (sizeof(op_str) / sizeof(op_str[0]))
+
+static struct {
+    const backend_t* backend;
+    uint32_t num_runs;
+
+    uint8_t* trace;
+    size_t   trace_num_bytes;
+    ll_trace_header_t header;
+
+    ll_flash_config_t ll;
+    page_dsc_t*   pages;
+    sector_dsc_t* sectors;
+    bool geometry_valid;
+
+    uint8_t* buffer;
+    uint32_t buffer_num_bytes;
+
+    op_stats_t stats[NUM_TRACE_OPS];
+} replay;
+
+static void stub_setup(void)
+{
+    ll_flash_stub_set_persistence(false);
+}
+
+static void stub_nv_setup(void)
+{
+    ll_flash_stub_set_persistence(true);
+}
+
+static void nor_setup(void)
+{
+    const ll_flash_stub_program_mode_t nor_mode = { .nor = true, .once_per_word = true };
+    ll_flash_stub_set_persistence(false);
+    ll_flash_stub_set_program_mode(&nor_mode);
+}
+
+static ll_flash_status_t null_init(ll_flash_config_t* ll_config) { (void)ll_config; return ll_flash_status_ok; }
+static ll_flash_status_t null_read(uint32_t addr, uint8_t* data, uint32_t num_bytes) { (void)addr; (void)data; (void)num_bytes; return ll_flash_status_ok; }
+static ll_flash_status_t null_write(uint32_t addr, const uint8_t* data, uint32_t num_bytes) { (void)addr; (void)data; (void)num_bytes; return ll_flash_status_ok; }
+static ll_flash_status_t null_range_erase(uint32_t first_page_idx, uint32_t page_count) { (void)first_page_idx; (void)page_count; return ll_flash_status_ok; }
+
+static const backend_t backends[] = {
+    { "stub",    stub_setup,    ll_flash_init, ll_flash_read, ll_flash_write, ll_flash_range_erase },
+    { "stub-nv", stub_nv_setup, ll_flash_init, ll_flash_read, ll_flash_write, ll_flash_range_erase },
+    { "nor",     nor_setup,     ll_flash_init, ll_flash_read, ll_flash_write, ll_flash_range_erase },
+    { "null",    NULL,          null_init,     null_read,     null_write,     null_range_erase },
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static bool load_trace(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if(f == NULL)
+    {
+        perror("trace_replay: fopen");
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    replay.trace = malloc((size > 0) ? (size_t)size : 1);
+    replay.trace_num_bytes = (size > 0) ? fread(replay.trace, 1, (size_t)size, f) : 0;
+    fclose(f);
+
+    if(replay.trace_num_bytes < sizeof(ll_trace_header_t))
+    {
+        fprintf(stderr, "trace_replay: %s is not a trace\n", path);
+        return false;
+    }
+
+    memcpy(&replay.header, replay.trace, sizeof(replay.header));
+    if((replay.header.magic != LL_TRACE_MAGIC) || (replay.header.version != LL_TRACE_VERSION) ||
+       (replay.header.record_num_bytes != sizeof(ll_trace_record_t)))
+    {
+        fprintf(stderr, "trace_replay: %s: unsupported trace format\n", path);
+        return false;
+    }
+    return true;
+}
+
+// Rebuilds the ll config from a geometry record, the backend is (re)initialised when it changed
+static bool apply_geometry(const ll_trace_record_t* record, const uint8_t* descriptors, size_t num_bytes_left)
+{
+    size_t pages_num_bytes   = (size_t)record->addr * sizeof(page_dsc_t);
+    size_t sectors_num_bytes = (size_t)record->num_bytes * sizeof(sector_dsc_t);
+    if((record->addr == 0) || ((pages_num_bytes + sectors_num_bytes) > num_bytes_left))
+    {
+        return false;
+    }
+
+    bool unchanged = replay.geometry_valid &&
+                     (replay.ll.pages_total_num == record->addr) &&
+                     (replay.ll.sectors_total_num == record->num_bytes) &&
+                     (replay.ll.write_granularity == (flash_write_size_t)record->aux) &&
+                     (memcmp(replay.pages, descriptors, pages_num_bytes) == 0) &&
+                     (memcmp(replay.sectors, descriptors + pages_num_bytes, sectors_num_bytes) == 0);
+    if(unchanged)
+    {
+        return true;
+    }
+
+    free(replay.pages);
+    free(replay.sectors);
+    replay.pages   = malloc(pages_num_bytes);
+    replay.sectors = malloc(sectors_num_bytes ? sectors_num_bytes : 1);
+    memcpy(replay.pages, descriptors, pages_num_bytes);
+    memcpy(replay.sectors, descriptors + pages_num_bytes, sectors_num_bytes);
+
+    replay.ll = (ll_flash_config_t){
+        .pages_total_num    = record->addr,
+        .write_granularity  = (flash_write_size_t)record->aux,
+        .page_descriptors   = replay.pages,
+        .sectors_total_num  = record->num_bytes,
+        .sector_descriptors = replay.sectors,
+    };
+    replay.geometry_valid = true;
+
+    // A trace started after init carries no init record, bring the backend up here
+    replay.backend->init(&replay.ll);
+    return true;
+}
+
+static uint8_t* op_buffer(uint32_t num_bytes)
+{
+    if(num_bytes > replay.buffer_num_bytes)
+    {
+        replay.buffer = realloc(replay.buffer, num_bytes);
+        if(replay.buffer == NULL)
+        {
+            perror("trace_replay: realloc");
+            exit(EXIT_FAILURE);
+        }
+        // Programs use this as their payload, leave bits to clear on erased flash
+        memset(replay.buffer + replay.buffer_num_bytes, 0x5A, num_bytes - replay.buffer_num_bytes);
+        replay.buffer_num_bytes = num_bytes;
+    }
+    return replay.buffer;
+}
+
+static bool replay_run(void)
+{
+    size_t offset = sizeof(ll_trace_header_t);
+
+    while((offset + sizeof(ll_trace_record_t)) <= replay.trace_num_bytes)
+    {
+        ll_trace_record_t record;
+        memcpy(&record, replay.trace + offset, sizeof(record));
+        offset += sizeof(record);
+
+        if(record.op >= NUM_TRACE_OPS)
+        {
+            fprintf(stderr, "trace_replay: unknown op %u at offset %zu\n", record.op, offset - sizeof(record));
+            return false;
+        }
+
+        if(record.op == ll_trace_op_geometry)
+        {
+            if(!apply_geometry(&record, replay.trace + offset, replay.trace_num_bytes - offset))
+            {
+                fprintf(stderr, "trace_replay: bad geometry record at offset %zu\n", offset - sizeof(record));
+                return false;
+            }
+            offset += (size_t)record.addr * sizeof(page_dsc_t) + (size_t)record.num_bytes * sizeof(sector_dsc_t);
+            continue;
+        }
+
+        if(!replay.geometry_valid)
+        {
+            fprintf(stderr, "trace_replay: op before any geometry record\n");
+            return false;
+        }
+
+        uint8_t* data = ((record.op == ll_trace_op_read) || (record.op == ll_trace_op_write))
+                            ? op_buffer(record.num_bytes) : NULL;
+        ll_flash_status_t status = ll_flash_status_ok;
+
+        uint64_t start = now_ns();
+        switch(record.op)
+        {
+            case ll_trace_op_init:  status = replay.backend->init(&replay.ll);                            break;
+            case ll_trace_op_read:  status = replay.backend->read(record.addr, data, record.num_bytes);    break;
+            case ll_trace_op_write: status = replay.backend->write(record.addr, data, record.num_bytes);   break;
+            case ll_trace_op_erase: status = replay.backend->range_erase(record.addr, record.num_bytes);  break;
+            default: break;
+        }
+        uint64_t elapsed = now_ns() - start;
+
+        op_stats_t* stats = &replay.stats[record.op];
+        stats->count          += 1;
+        stats->num_bytes      += (record.op == ll_trace_op_erase) ? 0 : record.num_bytes;
+        stats->replay_ns      += elapsed;
+        stats->recorded_ticks += record.duration;
+        stats->status_mismatches += (status != (ll_flash_status_t)record.status);
+    }
+
+    return true;
+}
+
+static void report(const char* path)
+{
+    bool has_clock = (replay.header.clock_hz != 0);
+    op_stats_t total = { 0 };
+
+    printf("trace_replay: %s, backend %s, %u run(s)%s\n", path, replay.backend->name, replay.num_runs,
+           (replay.header.flags & LL_TRACE_FLAG_HASHES) ? ", payload hashes ignored" : "");
+    printf("%-8s %10s %14s %14s %14s %10s\n", "op", "count", "bytes", "replay us", "recorded us", "status !=");
+
+    for(uint32_t op = ll_trace_op_init; op < NUM_TRACE_OPS; ++op)
+    {
+        const op_stats_t* stats = &replay.stats[op];
+        double recorded_us = has_clock ? ((double)stats->recorded_ticks * 1e6 / replay.header.clock_hz) : 0.0;
+        printf("%-8s %10llu %14llu %14.1f %14.1f %10llu\n", op_str[op],
+               (unsigned long long)stats->count, (unsigned long long)stats->num_bytes,
+               (double)stats->replay_ns / 1e3, recorded_us, (unsigned long long)stats->status_mismatches);
+
+        total.count             += stats->count;
+        total.num_bytes         += stats->num_bytes;
+        total.replay_ns         += stats->replay_ns;
+        total.recorded_ticks    += stats->recorded_ticks;
+        total.status_mismatches += stats->status_mismatches;
+    }
+
+    double recorded_us = has_clock ? ((double)total.recorded_ticks * 1e6 / replay.header.clock_hz) : 0.0;
+    printf("%-8s %10llu %14llu %14.1f %14.1f %10llu\n", "total",
+           (unsigned long long)total.count, (unsigned long long)total.num_bytes,
+           (double)total.replay_ns / 1e3, recorded_us, (unsigned long long)total.status_mismatches);
+    if(!has_clock)
+    {
+        printf("trace_replay: trace was captured without a clock, no recorded times\n");
+    }
+}
+
+#define USAGE "usage: %s [-b stub|stub-nv|nor|null] [-m heap|mmap|huge] [-r runs] trace_file\n"
+
+int main(int argc, char* argv[])
+{
+    const char* backend_name = "stub";
+    const char* memory_name  = "heap";
+    replay.num_runs = 1;
+
+    int opt;
+    while((opt = getopt(argc, argv, "b:m:r:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'b': backend_name    = optarg; break;
+            case 'm': memory_name     = optarg; break;
+            case 'r': replay.num_runs = (uint32_t)atoi(optarg); break;
+            default:
+                fprintf(stderr, USAGE, argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    ll_flash_stub_allocator_t allocator;
+    if(strcmp(memory_name, "heap") == 0)
+    {
+        allocator = ll_flash_stub_heap_allocator();
+    }
+    else if((strcmp(memory_name, "mmap") == 0) || (strcmp(memory_name, "huge") == 0))
+    {
+        allocator = ll_flash_stub_mmap_allocator(strcmp(memory_name, "huge") == 0);
+    }
+    else
+    {
+        fprintf(stderr, USAGE, argv[0]);
+        return EXIT_FAILURE;
+    }
+    ll_flash_stub_set_allocator(&allocator);
+
+    for(uint32_t idx = 0; idx < (sizeof(backends) / sizeof(backends[0])); ++idx)
+    {
+        if(strcmp(backends[idx].name, backend_name) == 0)
+        {
+            replay.backend = &backends[idx];
+        }
+    }
+
+    if((replay.backend == NULL) || (replay.num_runs == 0) || (optind != (argc - 1)))
+    {
+        fprintf(stderr, USAGE, argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(!load_trace(argv[optind]))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if(replay.backend->setup != NULL)
+    {
+        replay.backend->setup();
+    }
+
+    for(uint32_t run = 0; run < replay.num_runs; ++run)
+    {
+        if(!replay_run())
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    report(argv[optind]);
+    return EXIT_SUCCESS;
+}